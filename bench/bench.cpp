@@ -0,0 +1,551 @@
+#include <nicestream.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Measures the throughput of the manipulators on generated data, next to
+// plain istream extraction and std::regex doing the same work. MB/s is the
+// size of the input read, or of the output written for join, per second.
+
+namespace {
+
+// Deterministic, so every run parses the same data.
+class random_bytes
+{
+    uint64_t state;
+
+  public:
+    random_bytes(uint64_t seed)
+        : state(seed)
+    {}
+
+    uint32_t operator()(uint32_t bound)
+    {
+        this->state =
+            this->state * 6364136223846793005ull + 1442695040888963407ull;
+        return static_cast<uint32_t>(this->state >> 33) % bound;
+    }
+};
+
+struct dataset
+{
+    std::string text;
+    size_t records = 0;
+};
+
+// Rows of eight numbers, integers and decimals alternating.
+dataset numeric_csv(size_t size)
+{
+    random_bytes random(1);
+    dataset result;
+    while (result.text.size() < size) {
+        for (int col = 0; col < 8; ++col) {
+            result.text += std::to_string(random(100000));
+            if (col % 2 == 1) {
+                result.text += '.' + std::to_string(random(1000));
+            }
+            result.text += col == 7 ? '\n' : ',';
+        }
+        ++result.records;
+    }
+    return result;
+}
+
+// The same numbers, whitespace separated, one record per number.
+dataset numeric_tokens(size_t size)
+{
+    dataset result = numeric_csv(size);
+    std::replace(result.text.begin(), result.text.end(), ',', ' ');
+    result.records *= 8;
+    return result;
+}
+
+// Lines of 100 to 2000 bytes of words.
+dataset log_lines(size_t size)
+{
+    static const char* words[] = { "GET",     "/index.html", "200",
+                                   "client",  "timeout",     "user=42",
+                                   "latency", "ms",          "[warn]" };
+    random_bytes random(2);
+    dataset result;
+    while (result.text.size() < size) {
+        const size_t length = 100 + random(1900);
+        const size_t begin = result.text.size();
+        while (result.text.size() - begin < length) {
+            result.text += words[random(9)];
+            result.text += ' ';
+        }
+        result.text.back() = '\n';
+        ++result.records;
+    }
+    return result;
+}
+
+// Numbers to join, and the text joining them gives.
+dataset joined_numbers(size_t size, std::vector<int>& numbers)
+{
+    random_bytes random(5);
+    dataset result;
+    while (result.text.size() < size) {
+        numbers.push_back(static_cast<int>(random(1000000)));
+        result.text += std::to_string(numbers.back()) + ',';
+        ++result.records;
+    }
+    result.text.pop_back();
+    return result;
+}
+
+// Runs of 1 to 200 digits separated by semicolons.
+dataset digit_runs(size_t size)
+{
+    random_bytes random(3);
+    dataset result;
+    while (result.text.size() < size) {
+        const size_t length = 1 + random(200);
+        for (size_t i = 0; i < length; ++i) {
+            result.text += static_cast<char>('0' + random(10));
+        }
+        result.text += ';';
+        ++result.records;
+    }
+    return result;
+}
+
+// Runs of 1 to 30 a's, each ended by a b, for stacked quantifiers.
+dataset a_runs(size_t size)
+{
+    random_bytes random(4);
+    dataset result;
+    while (result.text.size() < size) {
+        result.text.append(1 + random(30), 'a');
+        result.text += 'b';
+        ++result.records;
+    }
+    return result;
+}
+
+// Records like "user12=alice;ts=1700000012", one per line.
+dataset key_values(size_t size)
+{
+    static const char* names[] = { "alice", "bob", "carol", "dave", "" };
+    random_bytes random(6);
+    dataset result;
+    while (result.text.size() < size) {
+        result.text += "user" + std::to_string(random(1000)) + '=' +
+                       names[random(5)] +
+                       ";ts=" + std::to_string(1700000000 + random(100000)) +
+                       '\n';
+        ++result.records;
+    }
+    return result;
+}
+
+struct benchmark
+{
+    const char* name;
+    const char* baseline_of;
+    const dataset* data;
+    // Processes the data once, returns something derived from the result so
+    // the work can't be optimized away.
+    std::function<size_t(const std::string&)> run;
+};
+
+struct result
+{
+    const benchmark* bench;
+    double seconds;
+};
+
+volatile size_t sink;
+
+double best_time(const benchmark& bench, size_t reps)
+{
+    double best = 0;
+    for (size_t i = 0; i < reps; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        sink = sink + bench.run(bench.data->text);
+        const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        if (i == 0 || elapsed.count() < best) {
+            best = elapsed.count();
+        }
+    }
+    return best;
+}
+
+std::vector<benchmark> make_benchmarks(const dataset& csv,
+                                       const dataset& tokens,
+                                       const dataset& logs,
+                                       const dataset& digits,
+                                       const dataset& runs,
+                                       const dataset& records,
+                                       const dataset& joined,
+                                       const std::vector<int>& numbers)
+{
+    using namespace nstr;
+    typedef std::istringstream in;
+    return {
+        { "skip", nullptr, &tokens,
+          [](const std::string& text) {
+              in is(text);
+              size_t count = 0;
+              while (is >> skip<int, double>()) {
+                  count += 2;
+              }
+              return count;
+          } },
+        { "istream_skip", "skip", &tokens,
+          [](const std::string& text) {
+              in is(text);
+              int i;
+              double d;
+              size_t count = 0;
+              while (is >> i >> d) {
+                  count += 2;
+              }
+              return count;
+          } },
+        { "sep", nullptr, &csv,
+          [](const std::string& text) {
+              in is(text);
+              double d, sum = 0;
+              sep<> comma("[,\n]");
+              while (is.peek() != EOF) {
+                  is >> d >> comma;
+                  sum += d;
+              }
+              return static_cast<size_t>(sum);
+          } },
+        { "istream_sep", "sep", &csv,
+          [](const std::string& text) {
+              in is(text);
+              double d, sum = 0;
+              char c;
+              while (is >> d && is.get(c)) {
+                  sum += d;
+              }
+              return static_cast<size_t>(sum);
+          } },
+        { "until", nullptr, &logs,
+          [](const std::string& text) {
+              in is(text);
+              std::string line;
+              size_t length = 0;
+              while (is.peek() != EOF) {
+                  line.clear();
+                  is >> until("\n", line);
+                  length += line.size();
+              }
+              return length;
+          } },
+        { "istream_until", "until", &logs,
+          [](const std::string& text) {
+              in is(text);
+              std::string line;
+              size_t length = 0;
+              while (std::getline(is, line)) {
+                  length += line.size();
+              }
+              return length;
+          } },
+        { "until_stacked", nullptr, &runs,
+          [](const std::string& text) {
+              in is(text);
+              std::string run;
+              size_t length = 0;
+              while (is.peek() != EOF) {
+                  run.clear();
+                  is >> until("a*a*a*a*b", run);
+                  length += run.size();
+              }
+              return length;
+          } },
+        { "std_regex_until_stacked", "until_stacked", &runs,
+          [](const std::string& text) {
+              const std::regex rx("a*a*a*a*b");
+              size_t count = 0;
+              for (std::sregex_iterator it(text.begin(), text.end(), rx), end;
+                   it != end;
+                   ++it) {
+                  ++count;
+              }
+              return count;
+          } },
+        { "pattn", nullptr, &digits,
+          [](const std::string& text) {
+              in is(text);
+              std::string run;
+              size_t length = 0;
+              while (is.peek() != EOF) {
+                  is >> pattn("\\d{1,200}", run) >> sep(";");
+                  length += run.size();
+              }
+              return length;
+          } },
+        { "pattn_counted", nullptr, &digits,
+          [](const std::string& text) {
+              in is(text);
+              std::string run;
+              size_t length = 0;
+              while (is.peek() != EOF) {
+                  is >> pattn("\\d{1,1000}", run) >> sep(";");
+                  length += run.size();
+              }
+              return length;
+          } },
+        { "std_regex_pattn", "pattn", &digits,
+          [](const std::string& text) {
+              const std::regex rx("\\d{1,200}");
+              size_t length = 0;
+              for (std::sregex_iterator it(text.begin(), text.end(), rx), end;
+                   it != end;
+                   ++it) {
+                  length += it->length();
+              }
+              return length;
+          } },
+        { "match", nullptr, &records,
+          [](const std::string& text) {
+              in is(text);
+              std::string key, value;
+              long ts;
+              size_t length = 0;
+              while (is.peek() != EOF) {
+                  is >> match("(\\w+)=(\\w*);ts=(\\d+)\n", key, value, ts);
+                  length += key.size() + value.size() + ts % 10;
+              }
+              return length;
+          } },
+        { "format", nullptr, &records,
+          [](const std::string& text) {
+              in is(text);
+              format fmt("(\\w+)=(\\w*);ts={int}");
+              std::string key, value;
+              long ts;
+              size_t length = 0;
+              while (is.peek() != EOF) {
+                  is >> fmt(key, value, ts);
+                  length += key.size() + value.size() + ts % 10;
+              }
+              return length;
+          } },
+        { "pattn_chained", "match", &records,
+          [](const std::string& text) {
+              in is(text);
+              std::string key, value;
+              long ts;
+              size_t length = 0;
+              while (is.peek() != EOF) {
+                  is >> pattn("\\w+", key) >> sep("=") >>
+                      pattn("\\w*", value) >> sep(";ts=") >>
+                      pattn("\\d+", ts) >> sep("\n");
+                  length += key.size() + value.size() + ts % 10;
+              }
+              return length;
+          } },
+        { "split", nullptr, &csv,
+          [](const std::string& text) {
+              in is(text);
+              std::vector<double> row;
+              size_t count = 0;
+              while (is.peek() != EOF) {
+                  row.clear();
+                  is >> split(",", "\n", row);
+                  count += row.size();
+              }
+              return count;
+          } },
+        { "split_source", "split", &csv,
+          [](const std::string& text) {
+              string_source src(text);
+              std::vector<double> row;
+              size_t count = 0;
+              while (!src.eof()) {
+                  row.clear();
+                  src >> split(",", "\n", row);
+                  count += row.size();
+              }
+              return count;
+          } },
+        { "istream_split", "split", &csv,
+          [](const std::string& text) {
+              in is(text);
+              std::string line, field;
+              size_t count = 0;
+              while (std::getline(is, line)) {
+                  in fields(line);
+                  while (std::getline(fields, field, ',')) {
+                      count += std::stod(field) >= 0;
+                  }
+              }
+              return count;
+          } },
+        { "all", nullptr, &logs,
+          [](const std::string& text) {
+              in is(text);
+              std::string content;
+              is >> all(content);
+              return content.size();
+          } },
+        { "istream_all", "all", &logs,
+          [](const std::string& text) {
+              in is(text);
+              const std::string content(std::istreambuf_iterator<char>(is),
+                                        {});
+              return content.size();
+          } },
+        { "join", nullptr, &joined,
+          [&numbers](const std::string&) {
+              std::ostringstream os;
+              os << join(",", numbers);
+              return os.str().size();
+          } },
+        { "parallel_join", nullptr, &joined,
+          [&numbers](const std::string&) {
+              std::ostringstream os;
+              os << parallel_join(",", numbers);
+              return os.str().size();
+          } },
+        { "ostream_join", "join", &joined,
+          [&numbers](const std::string&) {
+              std::ostringstream os;
+              for (size_t i = 0; i < numbers.size(); ++i) {
+                  if (i > 0) {
+                      os << ',';
+                  }
+                  os << numbers[i];
+              }
+              return os.str().size();
+          } },
+    };
+}
+
+void print_table(const std::vector<result>& results)
+{
+    std::printf("%-24s %-14s %10s %10s %12s\n",
+                "benchmark", "baseline of", "MB/s", "ns/record", "seconds");
+    for (const result& r : results) {
+        const dataset& data = *r.bench->data;
+        std::printf("%-24s %-14s %10.1f %10.1f %12.4f\n",
+                    r.bench->name,
+                    r.bench->baseline_of ? r.bench->baseline_of : "",
+                    data.text.size() / r.seconds / 1e6,
+                    r.seconds * 1e9 / data.records,
+                    r.seconds);
+    }
+}
+
+void print_csv(const std::vector<result>& results)
+{
+    std::printf("benchmark,baseline_of,bytes,records,seconds,mb_per_s,"
+                "ns_per_record\n");
+    for (const result& r : results) {
+        const dataset& data = *r.bench->data;
+        std::printf("%s,%s,%zu,%zu,%.6f,%.3f,%.3f\n",
+                    r.bench->name,
+                    r.bench->baseline_of ? r.bench->baseline_of : "",
+                    data.text.size(),
+                    data.records,
+                    r.seconds,
+                    data.text.size() / r.seconds / 1e6,
+                    r.seconds * 1e9 / data.records);
+    }
+}
+
+void print_json(const std::vector<result>& results)
+{
+    std::printf("[\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const result& r = results[i];
+        const dataset& data = *r.bench->data;
+        std::printf("  {\"benchmark\": \"%s\", \"baseline_of\": %s%s%s, "
+                    "\"bytes\": %zu, \"records\": %zu, \"seconds\": %.6f, "
+                    "\"mb_per_s\": %.3f, \"ns_per_record\": %.3f}%s\n",
+                    r.bench->name,
+                    r.bench->baseline_of ? "\"" : "",
+                    r.bench->baseline_of ? r.bench->baseline_of : "null",
+                    r.bench->baseline_of ? "\"" : "",
+                    data.text.size(),
+                    data.records,
+                    r.seconds,
+                    data.text.size() / r.seconds / 1e6,
+                    r.seconds * 1e9 / data.records,
+                    i + 1 < results.size() ? "," : "");
+    }
+    std::printf("]\n");
+}
+
+int usage()
+{
+    std::fprintf(stderr,
+                 "usage: nice_bench [--size MB] [--reps N] [--filter TEXT] "
+                 "[--format table|csv|json]\n");
+    return 2;
+}
+}
+
+int main(int argc, char** argv)
+{
+    size_t size = 8 << 20;
+    size_t reps = 3;
+    std::string filter, format = "table";
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 == argc) {
+            return usage();
+        }
+        const char* value = argv[++i];
+        if (arg == "--size") {
+            size = static_cast<size_t>(std::atof(value) * (1 << 20));
+        } else if (arg == "--reps") {
+            reps = std::max(1, std::atoi(value));
+        } else if (arg == "--filter") {
+            filter = value;
+        } else if (arg == "--format") {
+            format = value;
+        } else {
+            return usage();
+        }
+    }
+    if (format != "table" && format != "csv" && format != "json") {
+        return usage();
+    }
+
+    const dataset csv = numeric_csv(size);
+    const dataset tokens = numeric_tokens(size);
+    const dataset logs = log_lines(size);
+    // std::regex is too slow to go through the full size in a sane time.
+    const dataset digits = digit_runs(size / 8);
+    const dataset runs = a_runs(size / 8);
+    std::vector<int> numbers;
+    const dataset joined = joined_numbers(size, numbers);
+    const dataset records = key_values(size);
+
+    const std::vector<benchmark> benchmarks = make_benchmarks(
+        csv, tokens, logs, digits, runs, records, joined, numbers);
+    std::vector<result> results;
+    for (const benchmark& bench : benchmarks) {
+        if (!filter.empty() &&
+            std::string(bench.name).find(filter) == std::string::npos) {
+            continue;
+        }
+        results.push_back({ &bench, best_time(bench, reps) });
+    }
+    if (format == "csv") {
+        print_csv(results);
+    } else if (format == "json") {
+        print_json(results);
+    } else {
+        print_table(results);
+    }
+    return 0;
+}
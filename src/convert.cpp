@@ -0,0 +1,120 @@
+#include "convert.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace nstr_private {
+
+namespace {
+
+bool decimal_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+bool eight_digits(uint64_t chunk)
+{
+    return ((chunk & 0xf0f0f0f0f0f0f0f0) |
+            (((chunk + 0x0606060606060606) & 0xf0f0f0f0f0f0f0f0) >> 4)) ==
+           0x3333333333333333;
+}
+
+uint64_t eight_digit_value(uint64_t chunk)
+{
+    chunk -= 0x3030303030303030;
+    chunk = (chunk * 10) + (chunk >> 8);
+    return (((chunk & 0x000000ff000000ff) * (100 + (1000000ull << 32))) +
+            (((chunk >> 16) & 0x000000ff000000ff) * (1 + (10000ull << 32)))) >>
+           32;
+}
+#endif
+}
+
+const char* skip_space(const char* begin, const char* end)
+{
+    while (begin != end && std::isspace(static_cast<unsigned char>(*begin))) {
+        ++begin;
+    }
+    return begin;
+}
+
+bool parse_digits(const char* begin, const char* end, uint64_t& value)
+{
+    if (begin == end) {
+        return false;
+    }
+    while (begin != end && *begin == '0') {
+        ++begin;
+    }
+    // Up to 19 digits always fit into 64 bits.
+    const char* safe = begin + std::min<ptrdiff_t>(end - begin, 19);
+    uint64_t result = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; safe - begin >= 8; begin += 8) {
+        uint64_t chunk;
+        std::memcpy(&chunk, begin, 8);
+        if (!eight_digits(chunk)) {
+            return false;
+        }
+        result = result * 100000000 + eight_digit_value(chunk);
+    }
+#endif
+    for (; begin != end; ++begin) {
+        const unsigned digit = static_cast<unsigned char>(*begin) - '0';
+        if (digit > 9) {
+            return false;
+        }
+        if (begin < safe) {
+            result = result * 10 + digit;
+        } else if (__builtin_mul_overflow(result, 10, &result) ||
+                   __builtin_add_overflow(result, digit, &result)) {
+            return false;
+        }
+    }
+    value = result;
+    return true;
+}
+
+bool below_one(const char* begin, const char* end)
+{
+    if (begin != end && (*begin == '+' || *begin == '-')) {
+        ++begin;
+    }
+    // The power of ten of the first nonzero digit.
+    long magnitude = 0;
+    bool point = false;
+    bool nonzero = false;
+    for (; begin != end && (*begin == '.' || decimal_digit(*begin)); ++begin) {
+        if (*begin == '.') {
+            point = true;
+        } else if (!point) {
+            if (nonzero || *begin != '0') {
+                magnitude += nonzero;
+                nonzero = true;
+            }
+        } else if (!nonzero) {
+            --magnitude;
+            nonzero = *begin != '0';
+        }
+    }
+    if (!nonzero) {
+        return true;
+    }
+    long exponent = 0;
+    if (begin != end && (*begin == 'e' || *begin == 'E')) {
+        ++begin;
+        const bool negative = begin != end && *begin == '-';
+        if (begin != end && (*begin == '+' || *begin == '-')) {
+            ++begin;
+        }
+        // Beyond this every type is out of range anyway.
+        for (; begin != end && decimal_digit(*begin) && exponent < 100000;
+             ++begin) {
+            exponent = exponent * 10 + (*begin - '0');
+        }
+        exponent = negative ? -exponent : exponent;
+    }
+    return magnitude + exponent < 0;
+}
+}
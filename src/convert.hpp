@@ -0,0 +1,121 @@
+#ifndef CONVERT_HPP_INCLUDED
+#define CONVERT_HPP_INCLUDED
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace nstr_private {
+
+template<typename T>
+constexpr bool is_char_v =
+    std::is_same_v<T, char> || std::is_same_v<T, signed char> ||
+    std::is_same_v<T, unsigned char> || std::is_same_v<T, wchar_t> ||
+    std::is_same_v<T, char16_t> || std::is_same_v<T, char32_t>;
+
+// Types read_from_string converts without a stringstream. Characters and bools
+// keep their stream semantics.
+template<typename T>
+constexpr bool parses_integer_v =
+    std::is_integral_v<T> && !std::is_same_v<T, bool> && !is_char_v<T>;
+
+#if defined(__cpp_lib_to_chars)
+template<typename T>
+constexpr bool parses_floating_v = std::is_floating_point_v<T>;
+#else
+template<typename T>
+constexpr bool parses_floating_v = false;
+#endif
+
+const char* skip_space(const char* begin, const char* end);
+
+// Parses unsigned decimal digits, eight at a time where possible. Fails on
+// anything but digits, on empty input and on overflow.
+bool parse_digits(const char* begin, const char* end, uint64_t& value);
+
+// Tells if a decimal number, exponent included, is less than one in magnitude.
+bool below_one(const char* begin, const char* end);
+
+// Like operator>> on a stream, but the whole range must be consumed.
+template<typename T>
+bool parse_integer(const char* begin, const char* end, T& value)
+{
+    begin = skip_space(begin, end);
+    const bool negative = begin != end && *begin == '-';
+    if (begin != end && (*begin == '-' || *begin == '+')) {
+        ++begin;
+    }
+    uint64_t magnitude;
+    if (!parse_digits(begin, end, magnitude)) {
+        return false;
+    }
+    if (negative && magnitude > 0) {
+        if (!std::is_signed_v<T> ||
+            magnitude - 1 > uint64_t(std::numeric_limits<T>::max())) {
+            return false;
+        }
+        value = -static_cast<T>(magnitude - 1) - 1;
+        return true;
+    }
+    if (magnitude > uint64_t(std::numeric_limits<T>::max())) {
+        return false;
+    }
+    value = static_cast<T>(magnitude);
+    return true;
+}
+
+#if defined(__cpp_lib_to_chars)
+template<typename T>
+bool parse_floating(const char* begin, const char* end, T& value)
+{
+    begin = skip_space(begin, end);
+    if (begin != end && *begin == '+') {
+        ++begin;
+        if (begin != end && (*begin == '+' || *begin == '-')) {
+            return false;
+        }
+    }
+    // from_chars also takes inf and nan, streams don't.
+    const char* first = begin != end && *begin == '-' ? begin + 1 : begin;
+    if (first == end || (*first != '.' && (*first < '0' || *first > '9'))) {
+        return false;
+    }
+    const std::from_chars_result result = std::from_chars(begin, end, value);
+    if (result.ptr != end) {
+        return false;
+    }
+    // Streams read numbers too small for T as zero.
+    if (result.ec == std::errc::result_out_of_range && below_one(first, end)) {
+        value = 0;
+        return true;
+    }
+    return result.ec == std::errc();
+}
+#endif
+
+// Tells if reading a T from a stream would succeed on the range.
+template<typename T>
+bool parses_as(const char* begin, const char* end)
+{
+    if constexpr (std::is_same_v<T, bool>) {
+        int value;
+        return parse_integer(begin, end, value) && (value == 0 || value == 1);
+    } else if constexpr (std::is_floating_point_v<T>) {
+        T value;
+        return parse_floating(begin, end, value);
+    } else {
+        // Streams wrap negative numbers into unsigned types.
+        begin = skip_space(begin, end);
+        if (std::is_unsigned_v<T> && begin != end && *begin == '-' &&
+            begin + 1 != end && *(begin + 1) != '+' && *(begin + 1) != '-') {
+            ++begin;
+        }
+        T value;
+        return parse_integer(begin, end, value);
+    }
+}
+}
+
+#endif
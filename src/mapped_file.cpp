@@ -0,0 +1,112 @@
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace nstr_private {
+
+const size_t mapped_buf::max_window;
+
+mapped_buf::mapped_buf(const char* data, size_t size)
+    : data(data)
+    , size(size)
+{
+    this->seek_to(0);
+}
+
+mapped_buf::pos_type mapped_buf::seek_to(size_t offset)
+{
+    char* begin = const_cast<char*>(this->data);
+    const size_t window = std::min(max_window, this->size - offset);
+    this->setg(begin, begin + offset, begin + offset + window);
+    return pos_type(off_type(offset));
+}
+
+mapped_buf::int_type mapped_buf::underflow()
+{
+    if (this->gptr() == this->egptr()) {
+        this->seek_to(this->gptr() - this->eback());
+    }
+    if (this->gptr() == this->egptr()) {
+        return traits_type::eof();
+    }
+    return traits_type::to_int_type(*this->gptr());
+}
+
+mapped_buf::pos_type mapped_buf::seekoff(off_type off,
+                                         std::ios_base::seekdir dir,
+                                         std::ios_base::openmode which)
+{
+    off_type base = this->gptr() - this->eback();
+    if (dir == std::ios_base::beg) {
+        base = 0;
+    } else if (dir == std::ios_base::end) {
+        base = this->size;
+    }
+    return this->seekpos(pos_type(base + off), which);
+}
+
+mapped_buf::pos_type mapped_buf::seekpos(pos_type pos,
+                                         std::ios_base::openmode which)
+{
+    const off_type offset = pos;
+    if (!(which & std::ios_base::in) || offset < 0 ||
+        size_t(offset) > this->size) {
+        return pos_type(off_type(-1));
+    }
+    return this->seek_to(offset);
+}
+}
+
+namespace nstr {
+
+std::string_view mapped_file::map(const std::string& path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw stream_error();
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 ||
+        uintmax_t(info.st_size) > uintmax_t(SIZE_MAX)) {
+        ::close(fd);
+        throw stream_error();
+    }
+    const size_t size = info.st_size;
+    if (size == 0) {
+        ::close(fd);
+        return std::string_view();
+    }
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        throw stream_error();
+    }
+    ::madvise(data, size, MADV_SEQUENTIAL);
+    return std::string_view(static_cast<const char*>(data), size);
+}
+
+mapped_file::mapped_file(const std::string& path)
+    : std::istream(nullptr)
+    , mapping(map(path))
+    , buf(this->mapping.data(), this->mapping.size())
+{
+    this->rdbuf(&this->buf);
+}
+
+mapped_file::~mapped_file()
+{
+    if (!this->mapping.empty()) {
+        ::munmap(const_cast<char*>(this->mapping.data()),
+                 this->mapping.size());
+    }
+}
+
+std::string_view mapped_file::view() const
+{
+    return this->mapping;
+}
+}
@@ -0,0 +1,59 @@
+#ifndef MAPPED_FILE_HPP_INCLUDED
+#define MAPPED_FILE_HPP_INCLUDED
+
+#include "nicein.hpp"
+#include <cstddef>
+#include <istream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+namespace nstr_private {
+
+// Stream buffer over bytes in memory. The whole range stays readable behind
+// the get pointer, but at most max_window bytes are ahead of it, so offsets
+// into the get area always fit into an int.
+class mapped_buf : public std::streambuf
+{
+    const char* data;
+    size_t size;
+
+    pos_type seek_to(size_t offset);
+
+  public:
+    static const size_t max_window = size_t(1) << 30;
+
+    mapped_buf(const char* data, size_t size);
+
+  protected:
+    int_type underflow() override;
+    pos_type seekoff(off_type off,
+                     std::ios_base::seekdir dir,
+                     std::ios_base::openmode which) override;
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+};
+}
+
+namespace nstr {
+
+// An input stream over a read-only memory mapping of a file. Manipulators read
+// straight from the mapped pages, without copying them into a stream buffer.
+class mapped_file : public std::istream
+{
+    std::string_view mapping;
+    nstr_private::mapped_buf buf;
+
+    static std::string_view map(const std::string& path);
+
+  public:
+    mapped_file(const std::string& path);
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+    ~mapped_file();
+
+    // The whole file, valid as long as the mapped_file is alive.
+    std::string_view view() const;
+};
+}
+
+#endif
@@ -1,10 +1,20 @@
 #include "nfa.hpp"
 #include "nicestream.hpp"
+#include "static_nfa.hpp"
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <set>
 
 using namespace nstr;
 
 namespace nstr_private {
 
+void invalid_static_regex()
+{
+    throw invalid_regex();
+}
+
 nfa_state::nfa_state(std::map<uint8_t, std::vector<int>>&& transitions,
                      std::vector<int>&& e_transitions,
                      match_state match)
@@ -33,8 +43,9 @@ nfa nfa::loop(nfa&& x)
         { {}, { 1, static_cast<int>(x.states.size()) }, match_state::UNSURE });
     for (size_t i = 1; i < x.states.size() - 1; ++i) {
         if (x.states[i].match == match_state::ACCEPT) {
-            x.states[i].e_transitions.push_back(x.states.size() - 1 - i);
+            // going around again first makes the loop greedy
             x.states[i].e_transitions.push_back(-static_cast<int>(i) + 1);
+            x.states[i].e_transitions.push_back(x.states.size() - 1 - i);
             x.states[i].match = match_state::UNSURE;
         }
     }
@@ -51,8 +62,24 @@ nfa nfa::unite(nfa&& lhs, nfa&& rhs)
     return std::move(lhs);
 }
 
+// Copies x for every repetition, except for large bounds on a byte set, which
+// are counted. Anything else with such bounds, or copies adding up to more
+// than max_unrolled_states, would take too much space.
 nfa nfa::repeat(nfa&& x, int min, int max)
 {
+    if (max != -1 && max < min) {
+        throw invalid_regex();
+    }
+    const size_t copies = std::max(min, max);
+    if (copies > max_unrolled) {
+        if (!x.is_byte_set()) {
+            throw invalid_regex();
+        }
+        return count(std::move(x), min, max);
+    }
+    if (copies * x.states.size() > max_unrolled_states) {
+        throw invalid_regex();
+    }
     nfa result;
     nfa x_orig = std::move(x);
     for (int i = 0; i < min; ++i) {
@@ -61,24 +88,78 @@ nfa nfa::repeat(nfa&& x, int min, int max)
     if (max == -1) {
         result = concatenate(std::move(result), loop(std::move(x_orig)));
     } else {
-        if (max < min) {
-            throw invalid_regex();
-        }
+        // every optional copy is only entered from the copy before it
+        size_t last = min > 0 ? result.states.size() - x_orig.states.size()
+                              : 0;
         for (int i = 0; i < max - min; ++i) {
-            for (size_t j = 0; j < result.states.size(); ++j) {
+            const size_t end = result.states.size();
+            for (size_t j = last; j < end; ++j) {
                 if (result.states[j].match == match_state::ACCEPT) {
-                    result.states[j].e_transitions.push_back(
-                        result.states.size() - j);
+                    result.states[j].e_transitions.push_back(end - j);
                 }
             }
             result.states.insert(result.states.end(),
                                  x_orig.states.begin(),
                                  x_orig.states.end());
+            last = end;
         }
     }
     return result;
 }
 
+nfa nfa::count(nfa&& x, int min, int max)
+{
+    nfa_state counter({}, {}, match_state::UNSURE);
+    counter.counter = true;
+    for (const auto& transition : x.states[0].transitions) {
+        counter.count_bytes.set(transition.first);
+    }
+    counter.count_min = min;
+    counter.count_max = max;
+    if (min == 0) {
+        counter.e_transitions.push_back(1);
+    }
+    nfa result;
+    result.states.insert(result.states.begin(), std::move(counter));
+    return result;
+}
+
+// Wraps x in the states recording where capturing group index starts and
+// ends. Groups that don't capture are left as they are.
+nfa nfa::group(nfa&& x, int index)
+{
+    if (index < 0) {
+        return std::move(x);
+    }
+    nfa_state open({}, { 1 }, match_state::UNSURE);
+    open.tag = 2 * index;
+    x.states.insert(x.states.begin(), std::move(open));
+    nfa close;
+    close.states[0].tag = 2 * index + 1;
+    return concatenate(std::move(x), std::move(close));
+}
+
+// Tells if the automaton matches exactly one byte out of some set.
+bool nfa::is_byte_set() const
+{
+    if (this->states.size() != 2) {
+        return false;
+    }
+    const nfa_state& first = this->states[0];
+    const nfa_state& last = this->states[1];
+    if (first.counter || last.counter || !first.e_transitions.empty() ||
+        first.match != match_state::UNSURE || !last.transitions.empty() ||
+        !last.e_transitions.empty() || last.match != match_state::ACCEPT) {
+        return false;
+    }
+    for (const auto& transition : first.transitions) {
+        if (transition.second != std::vector<int>{ 1 }) {
+            return false;
+        }
+    }
+    return true;
+}
+
 nfa::nfa(uint8_t c)
 {
     this->states.push_back({ { { c, { 1 } } }, {}, match_state::UNSURE });
@@ -117,16 +198,49 @@ nfa::nfa()
     this->states.push_back({ {}, {}, match_state::ACCEPT });
 }
 
-nfa nfa::parse_regex(const char* regex, size_t size)
+// Parses alternatives up to the end of the regex, or up to the parenthesis
+// closing the group if nested. Groups are numbered in the order they open.
+nfa nfa::parse_regex(const char* regex,
+                     size_t size,
+                     size_t& offset,
+                     size_t& groups,
+                     bool nested)
 {
     std::vector<nfa> sequence;
+    nfa alternatives;
+    bool has_alternatives = false;
     bool escape = false;
-    for (size_t offset = 0; offset < size; ++offset) {
+    bool closed = false;
+    for (; offset < size; ++offset) {
         const char* base = regex + offset;
         size_t rem = size - offset;
         if (base[0] == '\\' && !escape) {
             escape = true;
             continue;
+        } else if (base[0] == '(' && !escape) {
+            int index = -1;
+            if (rem > 2 && base[1] == '?' && base[2] == ':') {
+                offset += 2;
+            } else {
+                index = static_cast<int>(groups++);
+            }
+            ++offset;
+            sequence.emplace_back(
+                group(parse_regex(regex, size, offset, groups, true), index));
+        } else if (base[0] == ')' && !escape) {
+            if (!nested) {
+                throw invalid_regex();
+            }
+            closed = true;
+            break;
+        } else if (base[0] == '|' && !escape) {
+            nfa alternative = concatenate_all(std::move(sequence));
+            sequence.clear();
+            alternatives = has_alternatives
+                               ? unite(std::move(alternatives),
+                                       std::move(alternative))
+                               : std::move(alternative);
+            has_alternatives = true;
         } else if (base[0] == '{' && !escape) {
             int min = 0, max = -1;
             bool comma_ok = false, brace_ok = false;
@@ -156,7 +270,7 @@ nfa nfa::parse_regex(const char* regex, size_t size)
                     throw invalid_regex();
                 }
             }
-            if (!brace_ok) {
+            if (!brace_ok || sequence.empty()) {
                 throw invalid_regex();
             }
             if (!comma_ok) {
@@ -164,17 +278,17 @@ nfa nfa::parse_regex(const char* regex, size_t size)
             }
             sequence.back() = repeat(std::move(sequence.back()), min, max);
         } else if (base[0] == '*' && !escape) {
-            if (offset == 0) {
+            if (sequence.empty()) {
                 throw invalid_regex();
             }
             sequence.back() = loop(std::move(sequence.back()));
         } else if (base[0] == '?' && !escape) {
-            if (offset == 0) {
+            if (sequence.empty()) {
                 throw invalid_regex();
             }
             sequence.back() = unite(std::move(sequence.back()), nfa());
         } else if (base[0] == '+' && !escape) {
-            if (offset == 0) {
+            if (sequence.empty()) {
                 throw invalid_regex();
             }
             sequence.emplace_back(loop(nfa(sequence.back())));
@@ -269,15 +383,27 @@ nfa nfa::parse_regex(const char* regex, size_t size)
         }
         escape = false;
     }
+    if (nested != closed) {
+        throw invalid_regex();
+    }
+    nfa result = concatenate_all(std::move(sequence));
+    if (has_alternatives) {
+        result = unite(std::move(alternatives), std::move(result));
+    }
+    result.group_count = groups;
+    return result;
+}
+
+nfa nfa::concatenate_all(std::vector<nfa>&& sequence)
+{
     if (sequence.empty()) {
         return nfa();
-    } else {
-        for (size_t i = 1; i < sequence.size(); ++i) {
-            sequence.front() = concatenate(std::move(sequence.front()),
-                                           std::move(sequence[i]));
-        }
-        return std::move(sequence.front());
     }
+    for (size_t i = 1; i < sequence.size(); ++i) {
+        sequence.front() = concatenate(std::move(sequence.front()),
+                                       std::move(sequence[i]));
+    }
+    return std::move(sequence.front());
 }
 
 const std::vector<nfa_state>& nfa::get_states() const
@@ -290,6 +416,7 @@ nfa& nfa::operator=(nfa&& other)
     if (this != &other) {
         this->states = std::move(other.states);
         this->current = std::move(other.current);
+        this->group_count = other.group_count;
     }
     return *this;
 }
@@ -301,7 +428,437 @@ nfa::nfa(nfa&& other)
 
 nfa::nfa(const std::string& regex)
 {
-    *this = parse_regex(regex.c_str(), regex.size());
+    size_t offset = 0, groups = 0;
+    *this = parse_regex(regex.c_str(), regex.size(), offset, groups, false);
+}
+
+nfa_scratch::nfa_scratch(const nfa_program& program)
+    : current(program.size())
+    , following(program.size())
+    , captures(program)
+{
+    this->stack.reserve(program.size());
+}
+
+const size_t nfa_program::max_pooled;
+
+void nfa_program::compute_byte_classes(const std::vector<nfa_state>& states)
+{
+    // Every distinct transition map splits the classes found so far by the
+    // targets it assigns to each byte.
+    std::vector<size_t> classes(256, 0);
+    std::set<std::map<uint8_t, std::vector<int>>> seen;
+    for (const auto& state : states) {
+        // counted bytes are told apart like the bytes of a transition
+        std::map<uint8_t, std::vector<int>> counted;
+        for (size_t c = 0; state.counter && c < 256; ++c) {
+            if (state.count_bytes[c]) {
+                counted[c] = { 1 };
+            }
+        }
+        const auto& transitions = state.counter ? counted : state.transitions;
+        if (transitions.empty() || !seen.insert(transitions).second) {
+            continue;
+        }
+        std::map<std::pair<size_t, std::vector<int>>, size_t> split;
+        for (size_t c = 0; c < 256; ++c) {
+            const auto it = transitions.find(c);
+            std::pair<size_t, std::vector<int>> key(
+                classes[c],
+                it == transitions.end() ? std::vector<int>() : it->second);
+            classes[c] = split.emplace(std::move(key), split.size())
+                             .first->second;
+        }
+    }
+    this->class_count = 0;
+    for (size_t c = 0; c < 256; ++c) {
+        this->byte_classes[c] = static_cast<uint8_t>(classes[c]);
+        this->class_count = std::max(this->class_count, classes[c] + 1);
+    }
+}
+
+nfa_program::nfa_program(const std::string& regex)
+{
+    NSTR_COUNT(const auto started = std::chrono::steady_clock::now();)
+    NSTR_COUNT(this->pattern = regex;)
+    const nfa automaton(regex);
+    const auto& states = automaton.get_states();
+    this->compute_byte_classes(states);
+    this->group_count = automaton.get_group_count();
+    if (this->group_count > 0) {
+        for (const auto& state : states) {
+            this->tags.push_back(state.tag);
+        }
+    }
+
+    std::vector<uint8_t> representative(this->class_count);
+    for (size_t c = 256; c > 0; --c) {
+        representative[this->byte_classes[c - 1]] = c - 1;
+    }
+    this->offsets.push_back(0);
+    this->e_offsets.push_back(0);
+    for (size_t i = 0; i < states.size(); ++i) {
+        this->matches.push_back(states[i].match);
+        for (size_t cls = 0; cls < this->class_count; ++cls) {
+            const auto it = states[i].transitions.find(representative[cls]);
+            if (it != states[i].transitions.end()) {
+                for (int offset : it->second) {
+                    this->targets.push_back(i + offset);
+                }
+            }
+            this->offsets.push_back(this->targets.size());
+        }
+        for (int offset : states[i].e_transitions) {
+            this->e_targets.push_back(i + offset);
+        }
+        this->e_offsets.push_back(this->e_targets.size());
+        if (states[i].counter) {
+            std::vector<bool> classes(this->class_count);
+            for (size_t cls = 0; cls < this->class_count; ++cls) {
+                classes[cls] = states[i].count_bytes[representative[cls]];
+            }
+            const size_t max = states[i].count_max < 0
+                                   ? static_cast<size_t>(-1)
+                                   : states[i].count_max;
+            this->counters.push_back(
+                { i, std::move(classes), size_t(states[i].count_min), max });
+        }
+    }
+    if (!this->counters.empty()) {
+        this->counter_indices.assign(states.size(), -1);
+        for (size_t i = 0; i < this->counters.size(); ++i) {
+            this->counter_indices[this->counters[i].state] = i;
+        }
+    }
+    this->compute_scanner();
+    this->compute_start_states();
+    if (this->group_count > 0 && this->counters.empty()) {
+        this->compute_one_pass();
+    }
+    NSTR_COUNT(const std::chrono::duration<double> elapsed =
+                   std::chrono::steady_clock::now() - started;
+               nfa_stats_registry::add_program(
+                   regex, this->size(), this->class_count, elapsed.count());)
+}
+
+void nfa_program::compute_start_states()
+{
+    std::vector<bool> seen(this->size());
+    std::vector<size_t> stack = { 0 };
+    seen[0] = true;
+    while (!stack.empty()) {
+        const size_t state = stack.back();
+        stack.pop_back();
+        if (this->reads(state)) {
+            this->start_states.push_back(state);
+        }
+        const auto range = this->e_transitions(state);
+        for (const uint32_t* it = range.first; it != range.second; ++it) {
+            if (!seen[*it]) {
+                seen[*it] = true;
+                stack.push_back(*it);
+            }
+        }
+    }
+}
+
+void nfa_program::compute_scanner()
+{
+    std::vector<bool> seen(this->size());
+    std::vector<size_t> stack = { 0 };
+    std::bitset<256> first;
+    seen[0] = true;
+    while (!stack.empty()) {
+        const size_t state = stack.back();
+        stack.pop_back();
+        if (this->match(state) == match_state::ACCEPT) {
+            // Empty matches can happen anywhere.
+            first.set();
+            break;
+        }
+        const int counter = this->counter_at(state);
+        for (size_t c = 0; c < 256; ++c) {
+            const size_t cls = this->byte_class(c);
+            const auto range = this->transitions(state, cls);
+            if (range.first != range.second ||
+                (counter >= 0 && this->counters[counter].classes[cls])) {
+                first.set(c);
+            }
+        }
+        const auto range = this->e_transitions(state);
+        for (const uint32_t* it = range.first; it != range.second; ++it) {
+            if (!seen[*it]) {
+                seen[*it] = true;
+                stack.push_back(*it);
+            }
+        }
+    }
+    this->scanner = byte_scanner(first);
+}
+
+namespace {
+
+struct closure_entry
+{
+    size_t state;
+    std::vector<int> tags;
+};
+
+// Lists the states reachable from state without reading a byte that read a
+// byte or accept, in order of priority, with the slots recorded on the way.
+void list_closure(const nfa_program& program,
+                  size_t state,
+                  std::vector<int>& tags,
+                  std::vector<bool>& seen,
+                  std::vector<closure_entry>& entries)
+{
+    if (seen[state]) {
+        return;
+    }
+    seen[state] = true;
+    const int tag = program.tag(state);
+    if (tag >= 0) {
+        tags.push_back(tag);
+    }
+    bool reads = program.match(state) == match_state::ACCEPT;
+    for (size_t cls = 0; !reads && cls < program.get_class_count(); ++cls) {
+        const auto range = program.transitions(state, cls);
+        reads = range.first != range.second;
+    }
+    if (reads) {
+        entries.push_back({ state, tags });
+    }
+    const auto range = program.e_transitions(state);
+    for (const uint32_t* it = range.first; it != range.second; ++it) {
+        list_closure(program, *it, tags, seen, entries);
+    }
+    if (tag >= 0) {
+        tags.pop_back();
+    }
+}
+}
+
+// Nodes are numbered by the state a byte transition leads to, and list the
+// states they reach in order of priority. The program isn't one-pass if two
+// of those can read the same byte, or one of them can go to two states on it.
+void nfa_program::compute_one_pass()
+{
+    one_pass_table table;
+    std::map<size_t, int> nodes = { { 0, 0 } };
+    std::vector<size_t> roots = { 0 };
+    auto make_action = [&table](int next, const std::vector<int>& tags) {
+        const uint32_t begin = table.tags.size();
+        table.tags.insert(table.tags.end(), tags.begin(), tags.end());
+        const uint32_t end = table.tags.size();
+        return one_pass_table::action{ next, begin, end };
+    };
+    for (size_t node = 0; node < roots.size(); ++node) {
+        std::vector<closure_entry> entries;
+        std::vector<int> tags;
+        std::vector<bool> seen(this->size());
+        list_closure(*this, roots[node], tags, seen, entries);
+        one_pass_table::action accept{ -1, 0, 0 };
+        for (const auto& entry : entries) {
+            if (this->match(entry.state) == match_state::ACCEPT) {
+                accept = make_action(0, entry.tags);
+                break;
+            }
+        }
+        table.accepts.push_back(accept);
+        for (size_t cls = 0; cls < this->class_count; ++cls) {
+            one_pass_table::action step{ -1, 0, 0 };
+            for (const auto& entry : entries) {
+                const auto range = this->transitions(entry.state, cls);
+                if (range.first == range.second) {
+                    continue;
+                }
+                if (step.next >= 0 || range.second - range.first != 1) {
+                    return;
+                }
+                const auto it = nodes.emplace(*range.first, roots.size());
+                if (it.second) {
+                    roots.push_back(*range.first);
+                }
+                step = make_action(it.first->second, entry.tags);
+            }
+            table.steps.push_back(step);
+        }
+    }
+    this->one_pass = std::move(table);
+}
+
+std::unique_ptr<nfa_scratch> nfa_program::acquire() const
+{
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        if (!this->pool.empty()) {
+            std::unique_ptr<nfa_scratch> scratch =
+                std::move(this->pool.back());
+            this->pool.pop_back();
+            return scratch;
+        }
+    }
+    return std::unique_ptr<nfa_scratch>(new nfa_scratch(*this));
+}
+
+void nfa_program::release(std::unique_ptr<nfa_scratch>&& scratch) const
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    if (this->pool.size() < max_pooled) {
+        this->pool.push_back(std::move(scratch));
+    }
+}
+
+const size_t nfa_cache::default_capacity;
+
+nfa_cache::nfa_cache()
+    : stats{ 0, 0, 0, 0, default_capacity }
+{}
+
+nfa_cache& nfa_cache::instance()
+{
+    static nfa_cache cache;
+    return cache;
+}
+
+void nfa_cache::shrink()
+{
+    while (this->entries.size() > this->stats.capacity) {
+        this->index.erase(this->entries.back().first);
+        this->entries.pop_back();
+        ++this->stats.evictions;
+    }
+    this->stats.size = this->entries.size();
+}
+
+std::shared_ptr<const nfa_program> nfa_cache::get(const std::string& regex)
+{
+    nfa_cache& cache = instance();
+    {
+        std::lock_guard<std::mutex> guard(cache.lock);
+        const auto it = cache.index.find(regex);
+        if (it != cache.index.end()) {
+            ++cache.stats.hits;
+            cache.entries.splice(
+                cache.entries.begin(), cache.entries, it->second);
+            return it->second->second;
+        }
+        ++cache.stats.misses;
+    }
+
+    // compile without holding the lock, other threads may keep matching
+    std::shared_ptr<const nfa_program> compiled =
+        std::make_shared<nfa_program>(regex);
+
+    std::lock_guard<std::mutex> guard(cache.lock);
+    const auto it = cache.index.find(regex);
+    if (it != cache.index.end()) {
+        return it->second->second;
+    }
+    if (cache.stats.capacity > 0) {
+        cache.entries.emplace_front(regex, compiled);
+        cache.index.emplace(regex, cache.entries.begin());
+        cache.shrink();
+    }
+    return compiled;
+}
+
+void nfa_cache::set_capacity(size_t capacity)
+{
+    nfa_cache& cache = instance();
+    std::lock_guard<std::mutex> guard(cache.lock);
+    cache.stats.capacity = capacity;
+    cache.shrink();
+}
+
+void nfa_cache::clear()
+{
+    nfa_cache& cache = instance();
+    std::lock_guard<std::mutex> guard(cache.lock);
+    cache.entries.clear();
+    cache.index.clear();
+    cache.stats.size = 0;
+}
+
+nfa_cache_stats nfa_cache::get_stats()
+{
+    nfa_cache& cache = instance();
+    std::lock_guard<std::mutex> guard(cache.lock);
+    return cache.stats;
+}
+
+bool nfa_counters::empty() const
+{
+    return this->bytes_scanned == 0 && this->bytes_skipped == 0 &&
+           this->closure_expansions == 0 && this->bytes_put_back == 0;
+}
+
+void nfa_counters::add(const nfa_counters& other)
+{
+    this->bytes_scanned += other.bytes_scanned;
+    this->bytes_skipped += other.bytes_skipped;
+    this->active_total += other.active_total;
+    this->active_peak = std::max(this->active_peak, other.active_peak);
+    this->closure_expansions += other.closure_expansions;
+    this->bytes_put_back += other.bytes_put_back;
+}
+
+double nfa_stats::average_active() const
+{
+    return this->bytes_scanned == 0
+               ? 0
+               : double(this->active_total) / this->bytes_scanned;
+}
+
+nfa_stats_registry& nfa_stats_registry::instance()
+{
+    // never destroyed, executors in static objects may still report to it
+    static nfa_stats_registry* registry = new nfa_stats_registry();
+    return *registry;
+}
+
+void nfa_stats_registry::add_program(const std::string& pattern,
+                                     size_t states,
+                                     size_t byte_classes,
+                                     double compile_seconds)
+{
+    nfa_stats_registry& registry = instance();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    nfa_stats& stats = registry.patterns[pattern];
+    stats.pattern = pattern;
+    stats.states = states;
+    stats.byte_classes = byte_classes;
+    ++stats.compilations;
+    stats.compile_seconds += compile_seconds;
+}
+
+void nfa_stats_registry::add_counters(const std::string& pattern,
+                                      const nfa_counters& counters)
+{
+    nfa_stats_registry& registry = instance();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    nfa_stats& stats = registry.patterns[pattern];
+    stats.pattern = pattern;
+    stats.add(counters);
+    ++stats.executors;
+}
+
+std::vector<nfa_stats> nfa_stats_registry::get()
+{
+    nfa_stats_registry& registry = instance();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    std::vector<nfa_stats> result;
+    for (const auto& entry : registry.patterns) {
+        result.push_back(entry.second);
+    }
+    return result;
+}
+
+void nfa_stats_registry::clear()
+{
+    nfa_stats_registry& registry = instance();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    registry.patterns.clear();
 }
 
 nfa_cursor::nfa_cursor(size_t index, size_t count)
@@ -309,92 +866,1056 @@ nfa_cursor::nfa_cursor(size_t index, size_t count)
     , count(count)
 {}
 
-void nfa_executor::transition_to(const nfa_cursor& cursor,
-                                 int offset,
-                                 std::vector<nfa_cursor>& index_set)
+cursor_set::cursor_set(size_t capacity)
+    : group_stamps(capacity, 0)
+    , set_stamps(capacity, 0)
+    , group_stamp(0)
+    , set_stamp(1)
+    , group_begin(0)
+    , group_count(0)
+    , group_open(false)
+    , group_fresh(false)
+{
+    this->cursors.reserve(capacity);
+}
+
+// Tells if the group of cursors with count holds index. Groups are filled
+// one at a time, so only the open one can.
+bool cursor_set::contains(size_t index, size_t count) const
+{
+    return this->group_open && this->group_count == count &&
+           this->group_stamps[index] == this->group_stamp;
+}
+
+bool cursor_set::holds(size_t index) const
+{
+    return this->set_stamps[index] == this->set_stamp;
+}
+
+void cursor_set::insert(size_t index, size_t count)
+{
+    if (!this->group_open || this->group_count != count) {
+        this->close_group();
+        ++this->group_stamp;
+        this->group_begin = this->cursors.size();
+        this->group_count = count;
+        this->group_open = true;
+        this->group_fresh = false;
+    }
+    this->group_stamps[index] = this->group_stamp;
+    if (this->set_stamps[index] != this->set_stamp) {
+        this->set_stamps[index] = this->set_stamp;
+        this->group_fresh = true;
+    }
+    this->cursors.emplace_back(index, count);
+}
+
+void cursor_set::close_group()
+{
+    if (this->group_open && !this->group_fresh) {
+        this->cursors.erase(this->cursors.begin() + this->group_begin,
+                            this->cursors.end());
+    }
+    this->group_open = false;
+}
+
+void cursor_set::retain_count(size_t count)
+{
+    this->close_group();
+    ++this->set_stamp;
+    size_t kept = 0;
+    for (const nfa_cursor& cursor : this->cursors) {
+        if (cursor.count == count) {
+            this->set_stamps[cursor.index] = this->set_stamp;
+            this->cursors[kept++] = cursor;
+        }
+    }
+    this->cursors.erase(this->cursors.begin() + kept, this->cursors.end());
+}
+
+void cursor_set::clear()
+{
+    this->cursors.clear();
+    ++this->set_stamp;
+    this->group_open = false;
+}
+
+bool cursor_set::empty() const
+{
+    return this->cursors.empty();
+}
+
+void entry_queue::push_back(const counter_entry& entry)
+{
+    if (this->head > 0 && this->head == this->entries.size()) {
+        this->clear();
+    }
+    this->entries.push_back(entry);
+}
+
+void entry_queue::pop_front()
+{
+    ++this->head;
+    // drop the popped entries once they're the bigger part
+    if (this->head > 32 && 2 * this->head > this->entries.size()) {
+        this->entries.erase(this->entries.begin(),
+                            this->entries.begin() + this->head);
+        this->head = 0;
+    }
+}
+
+void entry_queue::clear()
+{
+    this->entries.clear();
+    this->head = 0;
+}
+
+void counter_run::clear()
+{
+    this->entries.clear();
+    this->best.clear();
+    this->promoted = 0;
+}
+
+size_t cursor_set::size() const
+{
+    return this->cursors.size();
+}
+
+std::vector<nfa_cursor>::const_iterator cursor_set::begin() const
+{
+    return this->cursors.begin();
+}
+
+std::vector<nfa_cursor>::const_iterator cursor_set::end() const
+{
+    return this->cursors.end();
+}
+
+dfa_transition::dfa_transition(int target, int survivors)
+    : target(target)
+    , survivors(survivors)
+{}
+
+dfa_state::dfa_state(std::vector<size_t>&& groups, const nfa_program& program)
+    : groups(std::move(groups))
+    , group_count(0)
+    , transitions(program.get_class_count(), dfa_transition(-1, -1))
+    , with_start(-1, -1)
+    , match(match_state::REFUSE)
+    , accept_group(-1)
+{
+    for (size_t index : this->groups) {
+        if (index == lazy_dfa::group_end) {
+            ++this->group_count;
+            continue;
+        }
+        const match_state match_i = program.match(index);
+        if (match_i == match_state::ACCEPT && this->accept_group < 0) {
+            this->accept_group = static_cast<int>(this->group_count);
+        }
+        this->match = std::min(this->match, match_i);
+    }
+}
+
+const size_t lazy_dfa::group_end;
+const size_t lazy_dfa::max_states;
+
+void lazy_dfa::add_closure(const nfa_program& program,
+                           size_t state,
+                           std::vector<bool>& seen,
+                           std::vector<size_t>& group)
+{
+    if (seen[state]) {
+        return;
+    }
+    seen[state] = true;
+    const auto range = program.e_transitions(state);
+    for (const uint32_t* it = range.first; it != range.second; ++it) {
+        add_closure(program, *it, seen, group);
+    }
+    if (program.match(state) != match_state::REFUSE) {
+        group.push_back(state);
+    }
+}
+
+int lazy_dfa::add_survivors(std::vector<size_t>&& survivors)
+{
+    const auto it = this->survivor_index.find(survivors);
+    if (it != this->survivor_index.end()) {
+        return it->second;
+    }
+    this->survivor_lists.push_back(survivors);
+    const int list = static_cast<int>(this->survivor_lists.size() - 1);
+    this->survivor_index.emplace(std::move(survivors), list);
+    return list;
+}
+
+void lazy_dfa::clear()
+{
+    this->states.clear();
+    this->index.clear();
+    this->survivor_lists.clear();
+    this->survivor_index.clear();
+}
+
+bool lazy_dfa::full() const
 {
-    const auto& state = this->state_machine.get_states()[cursor.index + offset];
-    for (size_t i : state.e_transitions) {
-        this->transition_to(cursor, offset + i, index_set);
+    return this->states.size() >= max_states;
+}
+
+int lazy_dfa::intern(const nfa_program& program, std::vector<size_t>&& groups)
+{
+    const auto it = this->index.find(groups);
+    if (it != this->index.end()) {
+        return it->second;
+    }
+    this->states.emplace_back(std::vector<size_t>(groups), program);
+    const int state = static_cast<int>(this->states.size() - 1);
+    this->index.emplace(std::move(groups), state);
+    return state;
+}
+
+// Keeps the states just added to groups as a new group if any of them isn't
+// in an earlier group. Otherwise any match from the group's start ends where
+// one from an earlier start does, so matches are never trimmed to the group
+// and it's dropped.
+bool lazy_dfa::close_group(std::vector<bool>& covered,
+                           std::vector<size_t>& groups,
+                           size_t begin)
+{
+    bool fresh = false;
+    for (size_t i = begin; i < groups.size(); ++i) {
+        fresh = fresh || !covered[groups[i]];
+        covered[groups[i]] = true;
+    }
+    if (!fresh) {
+        groups.resize(begin);
+        return false;
+    }
+    std::sort(groups.begin() + begin, groups.end());
+    groups.push_back(group_end);
+    return true;
+}
+
+dfa_transition lazy_dfa::next(const nfa_program& program, int from, size_t cls)
+{
+    std::vector<bool> covered(program.size(), false);
+    std::vector<bool> seen(program.size(), false);
+    std::vector<size_t> groups, survivors;
+    size_t group = 0, begin = 0;
+    for (size_t index : this->states[from].groups) {
+        if (index == group_end) {
+            if (close_group(covered, groups, begin)) {
+                survivors.push_back(group);
+            }
+            seen.assign(seen.size(), false);
+            begin = groups.size();
+            ++group;
+            continue;
+        }
+        const auto range = program.transitions(index, cls);
+        for (const uint32_t* it = range.first; it != range.second; ++it) {
+            add_closure(program, *it, seen, groups);
+        }
     }
-    if (state.match != match_state::REFUSE) {
-        index_set.emplace_back(cursor.index + offset, cursor.count + 1);
+    const int list = survivors.size() == this->states[from].group_count
+                         ? -1
+                         : this->add_survivors(std::move(survivors));
+    const dfa_transition result(this->intern(program, std::move(groups)),
+                                list);
+    this->states[from].transitions[cls] = result;
+    return result;
+}
+
+dfa_transition lazy_dfa::start_path(const nfa_program& program, int from)
+{
+    std::vector<bool> covered(program.size(), false);
+    std::vector<bool> seen(program.size(), false);
+    std::vector<size_t> groups = this->states[from].groups;
+    for (size_t index : groups) {
+        if (index != group_end) {
+            covered[index] = true;
+        }
+    }
+    const size_t begin = groups.size();
+    add_closure(program, 0, seen, groups);
+    close_group(covered, groups, begin);
+    const dfa_transition result(this->intern(program, std::move(groups)), -1);
+    this->states[from].with_start = result;
+    return result;
+}
+
+int lazy_dfa::select_group(const nfa_program& program, int from, size_t group)
+{
+    std::vector<size_t> groups;
+    size_t current = 0;
+    for (size_t index : this->states[from].groups) {
+        if (current == group) {
+            groups.push_back(index);
+        }
+        if (index == group_end) {
+            ++current;
+        }
     }
+    return this->intern(program, std::move(groups));
+}
+
+const dfa_state& lazy_dfa::operator[](int state) const
+{
+    return this->states[state];
+}
+
+const std::vector<size_t>& lazy_dfa::survivors(int list) const
+{
+    return this->survivor_lists[list];
 }
 
-void nfa_executor::add_successor_states(uint8_t symbol,
-                                        const nfa_cursor& cursor,
-                                        std::vector<nfa_cursor>& cursor_set)
+void nfa_executor::add_closure(size_t index,
+                               size_t count,
+                               cursor_set& cursors)
 {
-    const auto& state = this->state_machine.get_states()[cursor.index];
-    const auto it = state.transitions.find(symbol);
-    if (it == state.transitions.end()) {
+    if (cursors.contains(index, count)) {
         return;
     }
-    for (size_t i : it->second) {
-        this->transition_to(cursor, i, cursor_set);
+    NSTR_COUNT(++this->stats.closure_expansions;)
+    const bool counted = this->program->has_counters();
+    std::vector<size_t>& stack = this->scratch->stack;
+    cursors.insert(index, count);
+    stack.push_back(index);
+    while (!stack.empty()) {
+        if (counted) {
+            this->enter_counter(stack.back(), count);
+        }
+        const auto range = this->program->e_transitions(stack.back());
+        stack.pop_back();
+        for (const uint32_t* it = range.first; it != range.second; ++it) {
+            if (!cursors.contains(*it, count)) {
+                cursors.insert(*it, count);
+                stack.push_back(*it);
+            }
+        }
+    }
+}
+
+// Tells if earlier groups hold every state a new path would read a byte or
+// accept in, so that its group would be dropped anyway.
+bool nfa_executor::start_covered() const
+{
+    for (uint32_t state : this->program->get_start_states()) {
+        if (!this->scratch->current.holds(state)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void nfa_executor::enter_counter(size_t state, size_t count)
+{
+    const int counter = this->program->counter_at(state);
+    if (counter >= 0) {
+        this->counters[counter].entries.push_back({ this->position, count });
+    }
+}
+
+// Promotes the entries that went through enough bytes to leave the counter.
+// An entry in best that started later than a promoted entry always gives a
+// shorter match, and leaves the counter earlier, so it's dropped.
+void nfa_executor::promote(counter_run& run, const counted_repeat& counter)
+{
+    const size_t min = std::max<size_t>(counter.min, 1);
+    while (run.promoted < run.entries.size() &&
+           this->position - run.entries[run.promoted].position >= min) {
+        const counter_entry& entry = run.entries[run.promoted++];
+        while (!run.best.empty() &&
+               run.best.back().count + entry.position <=
+                   entry.count + run.best.back().position) {
+            run.best.pop_back();
+        }
+        run.best.push_back(entry);
+    }
+}
+
+// Moves every counter one byte forward, and lists where cursors leave them in
+// order of decreasing count. Only the longest match leaving a counter matters,
+// as all of them reach the same state.
+void nfa_executor::advance_counters(size_t cls)
+{
+    std::vector<std::pair<size_t, size_t>>& exits = this->scratch->exits;
+    exits.clear();
+    for (size_t i = 0; i < this->counters.size(); ++i) {
+        counter_run& run = this->counters[i];
+        if (run.empty()) {
+            continue;
+        }
+        const counted_repeat& counter = this->program->counter(i);
+        if (!counter.classes[cls]) {
+            run.clear();
+            continue;
+        }
+        while (!run.entries.empty() &&
+               this->position - run.entries.front().position > counter.max) {
+            if (!run.best.empty() &&
+                run.best.front().position == run.entries.front().position) {
+                run.best.pop_front();
+            }
+            run.entries.pop_front();
+            run.promoted -= run.promoted > 0;
+        }
+        this->promote(run, counter);
+        if (!run.best.empty()) {
+            const counter_entry& best = run.best.front();
+            exits.emplace_back(best.count + this->position - best.position,
+                               counter.state + 1);
+        }
+    }
+    std::sort(exits.begin(), exits.end(), std::greater<>());
+}
+
+bool nfa_executor::make_room()
+{
+    // Refilling the whole cache in less than ten bytes per state means the
+    // DFA is thrashing, so the NFA is cheaper from here on. The bytes earlier
+    // users of the scratch fed the cache count too.
+    if (this->scratch->scanned + this->position - this->flush_position <
+        10 * lazy_dfa::max_states) {
+        this->leave_dfa();
+        return false;
+    }
+    lazy_dfa& dfa = this->scratch->dfa;
+    std::vector<size_t> groups = dfa[this->dfa_current].groups;
+    dfa.clear();
+    this->dfa_current = dfa.intern(*this->program, std::move(groups));
+    this->scratch->scanned = 0;
+    this->flush_position = this->position;
+    return true;
+}
+
+void nfa_executor::leave_dfa()
+{
+    lazy_dfa& dfa = this->scratch->dfa;
+    cursor_set& current = this->scratch->current;
+    current.clear();
+    size_t group = 0;
+    for (size_t index : dfa[this->dfa_current].groups) {
+        if (index == lazy_dfa::group_end) {
+            ++group;
+        } else {
+            current.insert(index, this->position - this->starts[group] + 1);
+        }
+    }
+    current.close_group();
+    dfa.clear();
+    this->scratch->scanned = 0;
+    this->starts.clear();
+    this->use_dfa = false;
+}
+
+void nfa_executor::release_scratch()
+{
+    if (this->use_dfa) {
+        this->scratch->scanned += this->position - this->flush_position;
     }
+    this->program->release(std::move(this->scratch));
 }
 
 void nfa_executor::start_path()
 {
-    this->transition_to({ 0, 0 }, 0, this->current);
+    if (this->use_dfa) {
+        lazy_dfa& dfa = this->scratch->dfa;
+        dfa_transition trans = dfa[this->dfa_current].with_start;
+        if (trans.target < 0) {
+            if (dfa.full() && !this->make_room()) {
+                this->start_path();
+                return;
+            }
+            trans = dfa.start_path(*this->program, this->dfa_current);
+            NSTR_COUNT(++this->stats.closure_expansions;)
+        }
+        if (dfa[trans.target].group_count >
+            dfa[this->dfa_current].group_count) {
+            this->starts.push_back(this->position);
+        }
+        this->dfa_current = trans.target;
+        return;
+    }
+    if (!this->start_covered()) {
+        this->add_closure(0, 1, this->scratch->current);
+        this->scratch->current.close_group();
+    }
 }
 
 void nfa_executor::next(uint8_t symbol)
 {
-    std::vector<nfa_cursor> next;
-    next.reserve(this->current.size());
-    for (const auto& cursor : this->current) {
-        this->add_successor_states(symbol, cursor, next);
+    const size_t cls = this->program->byte_class(symbol);
+    if (this->use_dfa) {
+        lazy_dfa& dfa = this->scratch->dfa;
+        dfa_transition trans = dfa[this->dfa_current].transitions[cls];
+        if (trans.target < 0) {
+            if (dfa.full() && !this->make_room()) {
+                this->next(symbol);
+                return;
+            }
+            trans = dfa.next(*this->program, this->dfa_current, cls);
+            NSTR_COUNT(++this->stats.closure_expansions;)
+        }
+        if (trans.survivors >= 0) {
+            const auto& survivors = dfa.survivors(trans.survivors);
+            for (size_t i = 0; i < survivors.size(); ++i) {
+                this->starts[i] = this->starts[survivors[i]];
+            }
+            this->starts.resize(survivors.size());
+        }
+        this->dfa_current = trans.target;
+        ++this->position;
+        NSTR_COUNT(this->count_active();)
+        return;
+    }
+    ++this->position;
+    if (this->program->has_counters()) {
+        this->advance_counters(cls);
     }
-    this->current = std::move(next);
+    // cursors leaving counters are merged in by count, keeping the order
+    const auto& exits = this->scratch->exits;
+    size_t exit = 0;
+    cursor_set& following = this->scratch->following;
+    following.clear();
+    for (const auto& cursor : this->scratch->current) {
+        for (; exit < exits.size() && exits[exit].first > cursor.count;
+             ++exit) {
+            this->add_closure(exits[exit].second, exits[exit].first, following);
+        }
+        const auto range = this->program->transitions(cursor.index, cls);
+        for (const uint32_t* it = range.first; it != range.second; ++it) {
+            this->add_closure(*it, cursor.count + 1, following);
+        }
+    }
+    for (; exit < exits.size(); ++exit) {
+        this->add_closure(exits[exit].second, exits[exit].first, following);
+    }
+    following.close_group();
+    std::swap(this->scratch->current, following);
+    NSTR_COUNT(this->count_active();)
 }
 
 match_state nfa_executor::match() const
 {
+    if (this->use_dfa) {
+        return this->scratch->dfa[this->dfa_current].match;
+    }
     match_state result = match_state::REFUSE;
-    for (size_t i = this->current.size(); i > 0; --i) {
-        const match_state match_i =
-            this->state_machine.get_states()[this->current[i - 1].index].match;
-        result = std::min(result, match_i);
+    for (const auto& cursor : this->scratch->current) {
+        result = std::min(result, this->program->match(cursor.index));
+    }
+    for (const auto& run : this->counters) {
+        if (!run.empty()) {
+            result = std::min(result, match_state::UNSURE);
+        }
     }
     return result;
 }
 
 void nfa_executor::reset()
 {
-    this->current.clear();
+    if (this->use_dfa) {
+        this->dfa_current = this->scratch->dfa.intern(*this->program, {});
+        this->starts.clear();
+    } else {
+        this->scratch->current.clear();
+        for (auto& run : this->counters) {
+            run.clear();
+        }
+    }
     this->start_path();
 }
 
 size_t nfa_executor::longest_match() const
 {
-    size_t result = 1;
-    for (size_t i = this->current.size(); i > 0; --i) {
-        const match_state match_i =
-            this->state_machine.get_states()[this->current[i - 1].index].match;
-        if (match_i == match_state::ACCEPT) {
-            result = std::max(current[i - 1].count, result);
+    if (this->use_dfa) {
+        const int group = this->scratch->dfa[this->dfa_current].accept_group;
+        return group < 0 ? 0 : this->position - this->starts[group];
+    }
+    for (const auto& cursor : this->scratch->current) {
+        if (this->program->match(cursor.index) == match_state::ACCEPT) {
+            return cursor.count - 1;
         }
     }
-    return result - 1;
+    return 0;
 }
 
 size_t nfa_executor::trim_short_matches()
 {
     size_t max = this->longest_match();
-    for (size_t i = this->current.size(); i > 0; --i) {
-        if (this->current[i - 1].count != max) {
-            this->current.erase(this->current.begin() + i);
+    if (this->use_dfa) {
+        size_t group = this->starts.size();
+        for (size_t i = 0; i < this->starts.size(); ++i) {
+            if (this->starts[i] == this->position - max) {
+                group = i;
+            }
+        }
+        this->dfa_current = this->scratch->dfa.select_group(
+            *this->program, this->dfa_current, group);
+        if (group < this->starts.size()) {
+            this->starts = { this->starts[group] };
+        } else {
+            this->starts.clear();
+        }
+        return max;
+    }
+    this->scratch->current.retain_count(max + 1);
+    for (size_t i = 0; i < this->counters.size(); ++i) {
+        counter_run& run = this->counters[i];
+        counter_run kept;
+        for (size_t j = 0; j < run.entries.size(); ++j) {
+            const counter_entry& entry = run.entries[j];
+            if (entry.count + this->position - entry.position == max + 1) {
+                kept.entries.push_back(entry);
+            }
         }
+        this->promote(kept, this->program->counter(i));
+        run = std::move(kept);
     }
     return max;
 }
 
+bool nfa_executor::idle() const
+{
+    if (this->use_dfa) {
+        return this->starts.size() == 1 && this->starts[0] == this->position;
+    }
+    for (const auto& cursor : this->scratch->current) {
+        if (cursor.count != 1) {
+            return false;
+        }
+    }
+    for (const auto& run : this->counters) {
+        if (!run.empty() && run.entries.front().position != this->position) {
+            return false;
+        }
+    }
+    return !this->scratch->current.empty();
+}
+
+void nfa_executor::skip(size_t count)
+{
+    NSTR_COUNT(this->stats.bytes_skipped += count;)
+    this->position += count;
+    if (this->use_dfa) {
+        this->starts[0] = this->position;
+    }
+    for (auto& run : this->counters) {
+        for (size_t i = 0; i < run.entries.size(); ++i) {
+            run.entries[i].position = this->position;
+        }
+    }
+}
+
+const byte_scanner& nfa_executor::scanner() const
+{
+    return this->program->get_scanner();
+}
+
+bool nfa_executor::find_groups(std::string_view input)
+{
+    return this->scratch->captures.find(input);
+}
+
+size_t nfa_executor::group_count() const
+{
+    return this->program->get_group_count();
+}
+
+std::string_view nfa_executor::group(size_t index) const
+{
+    return this->scratch->captures.group(index);
+}
+
+size_t nfa_executor::groups_closed(std::string_view input)
+{
+    return this->scratch->captures.groups_closed(input);
+}
+
+#ifdef NSTR_STATS
+void nfa_executor::count_active()
+{
+    size_t active;
+    if (this->use_dfa) {
+        const dfa_state& state = this->scratch->dfa[this->dfa_current];
+        active = state.groups.size() - state.group_count;
+    } else {
+        active = this->scratch->current.size();
+        for (const auto& run : this->counters) {
+            active += run.entries.size();
+        }
+    }
+    ++this->stats.bytes_scanned;
+    this->stats.active_total += active;
+    this->stats.active_peak = std::max(this->stats.active_peak, active);
+}
+
+void nfa_executor::flush_stats()
+{
+    if (this->program && !this->stats.empty()) {
+        nfa_stats_registry::add_counters(this->program->get_pattern(),
+                                         this->stats);
+    }
+    this->stats = nfa_counters();
+}
+
+void nfa_executor::count_put_back(size_t count)
+{
+    this->stats.bytes_put_back += count;
+}
+#endif
+
 nfa_executor::nfa_executor(const std::string& regex)
-    : state_machine(regex)
+    : program(nfa_cache::get(regex))
+    , scratch(program->acquire())
+    , use_dfa(!program->has_counters())
+    , dfa_current(0)
+    , position(0)
+    , flush_position(0)
+    , counters(program->counter_count())
 {
+    if (this->use_dfa) {
+        this->dfa_current = this->scratch->dfa.intern(*this->program, {});
+    } else {
+        this->scratch->current.clear();
+    }
     this->start_path();
 }
+
+nfa_executor::nfa_executor(const nfa_executor& other)
+    : program(other.program)
+    , scratch(program->acquire())
+    , use_dfa(other.use_dfa)
+    , dfa_current(0)
+    , starts(other.starts)
+    , position(other.position)
+    , flush_position(other.position)
+    , counters(other.counters)
+{
+    if (this->use_dfa) {
+        std::vector<size_t> groups =
+            other.scratch->dfa[other.dfa_current].groups;
+        this->dfa_current =
+            this->scratch->dfa.intern(*this->program, std::move(groups));
+    } else {
+        this->scratch->current.clear();
+        for (const auto& cursor : other.scratch->current) {
+            this->scratch->current.insert(cursor.index, cursor.count);
+        }
+        this->scratch->current.close_group();
+    }
+}
+
+nfa_executor::nfa_executor(nfa_executor&& other)
+    : program(std::move(other.program))
+    , scratch(std::move(other.scratch))
+    , use_dfa(other.use_dfa)
+    , dfa_current(other.dfa_current)
+    , starts(std::move(other.starts))
+    , position(other.position)
+    , flush_position(other.flush_position)
+    , counters(std::move(other.counters))
+{
+    NSTR_COUNT(std::swap(this->stats, other.stats);)
+}
+
+nfa_executor& nfa_executor::operator=(const nfa_executor& other)
+{
+    if (this != &other) {
+        *this = nfa_executor(other);
+    }
+    return *this;
+}
+
+nfa_executor& nfa_executor::operator=(nfa_executor&& other)
+{
+    if (this != &other) {
+        NSTR_COUNT(this->flush_stats();)
+        NSTR_COUNT(std::swap(this->stats, other.stats);)
+        if (this->scratch) {
+            this->release_scratch();
+        }
+        this->program = std::move(other.program);
+        this->scratch = std::move(other.scratch);
+        this->use_dfa = other.use_dfa;
+        this->dfa_current = other.dfa_current;
+        this->starts = std::move(other.starts);
+        this->position = other.position;
+        this->flush_position = other.flush_position;
+        this->counters = std::move(other.counters);
+    }
+    return *this;
+}
+
+nfa_executor::~nfa_executor()
+{
+    NSTR_COUNT(this->flush_stats();)
+    if (this->scratch) {
+        this->release_scratch();
+    }
+}
+
+const size_t capture_finder::unset;
+const size_t capture_finder::max_visited;
+
+capture_finder::capture_finder(const nfa_program& program)
+    : program(&program)
+    , consumes(program.size())
+    , path(2 * program.get_group_count(), unset)
+    , marks(program.size(), 0)
+    , counter_marks(program.counter_count(), 0)
+    , generation(0)
+    , groups(program.get_group_count())
+{
+    // states that only lead elsewhere don't need threads of their own
+    for (size_t state = 0; state < program.size(); ++state) {
+        bool reads = program.counter_at(state) >= 0 ||
+                     program.match(state) == match_state::ACCEPT;
+        for (size_t cls = 0; !reads && cls < program.get_class_count();
+             ++cls) {
+            const auto range = program.transitions(state, cls);
+            reads = range.first != range.second;
+        }
+        this->consumes[state] = reads;
+    }
+}
+
+void capture_finder::add_thread(size_t state, size_t count)
+{
+    const size_t slots = this->following_slots.size();
+    this->following.push_back({ state, count, slots });
+    this->following_slots.resize(slots + this->path.size());
+    std::copy(this->path.begin(),
+              this->path.end(),
+              this->following_slots.begin() + slots);
+}
+
+// Adds threads for the states reachable from state without reading a byte,
+// in order of priority. path holds the group boundaries on the way there.
+void capture_finder::follow(size_t state, size_t position)
+{
+    if (this->marks[state] == this->generation) {
+        return;
+    }
+    this->marks[state] = this->generation;
+    const int tag = this->program->tag(state);
+    const size_t saved = tag < 0 ? unset : this->path[tag];
+    if (tag >= 0) {
+        this->path[tag] = position;
+    }
+    const int counter = this->program->counter_at(state);
+    if (counter >= 0) {
+        this->add_thread(state, 0);
+        if (this->program->counter(counter).min == 0) {
+            this->follow(state + 1, position);
+        }
+    } else {
+        if (this->consumes[state]) {
+            this->add_thread(state, 0);
+        }
+        const auto range = this->program->e_transitions(state);
+        for (const uint32_t* it = range.first; it != range.second; ++it) {
+            this->follow(*it, position);
+        }
+    }
+    if (tag >= 0) {
+        this->path[tag] = saved;
+    }
+}
+
+// Threads in a counted repetition stay there while they can, which has
+// priority over leaving it. Past the minimum, counts of an unbounded
+// repetition don't make a difference, so they're merged.
+void capture_finder::step(size_t cls, size_t position)
+{
+    std::swap(this->current, this->following);
+    std::swap(this->current_slots, this->following_slots);
+    this->following.clear();
+    this->following_slots.clear();
+    ++this->generation;
+    for (const thread& current : this->current) {
+        const auto slots = this->current_slots.begin() + current.slots;
+        const int counter = this->program->counter_at(current.state);
+        if (counter < 0) {
+            const auto range =
+                this->program->transitions(current.state, cls);
+            if (range.first != range.second) {
+                std::copy_n(slots, this->path.size(), this->path.begin());
+            }
+            for (const uint32_t* it = range.first; it != range.second; ++it) {
+                this->follow(*it, position);
+            }
+            continue;
+        }
+        const counted_repeat& repeat = this->program->counter(counter);
+        if (!repeat.classes[cls] || current.count == repeat.max) {
+            continue;
+        }
+        std::copy_n(slots, this->path.size(), this->path.begin());
+        size_t count = current.count + 1;
+        if (repeat.max == unset && count >= repeat.min) {
+            count = std::max<size_t>(repeat.min, 1);
+            if (this->counter_marks[counter] == this->generation) {
+                continue;
+            }
+            this->counter_marks[counter] = this->generation;
+        }
+        this->add_thread(current.state, count);
+        if (count >= repeat.min) {
+            this->follow(current.state + 1, position);
+        }
+    }
+}
+
+bool capture_finder::find(std::string_view input)
+{
+    if (!this->program->get_one_pass().empty()) {
+        return this->run_one_pass(input);
+    }
+    if ((input.size() + 1) * this->program->size() <= max_visited) {
+        return this->backtrack(input);
+    }
+    return this->simulate(input);
+}
+
+bool capture_finder::run_one_pass(std::string_view input)
+{
+    const one_pass_table& table = this->program->get_one_pass();
+    const size_t classes = this->program->get_class_count();
+    std::fill(this->path.begin(), this->path.end(), unset);
+    size_t node = 0;
+    for (size_t i = 0; i <= input.size(); ++i) {
+        const one_pass_table::action& action =
+            i == input.size()
+                ? table.accepts[node]
+                : table.steps[node * classes +
+                              this->program->byte_class(input[i])];
+        if (action.next < 0) {
+            return false;
+        }
+        for (uint32_t tag = action.tags_begin; tag < action.tags_end; ++tag) {
+            this->path[table.tags[tag]] = i;
+        }
+        node = action.next;
+    }
+    this->set_groups(input, this->path.data());
+    return true;
+}
+
+bool capture_finder::backtrack(std::string_view input)
+{
+    const size_t states = this->program->size();
+    this->visited.assign(((input.size() + 1) * states + 63) / 64, 0);
+    std::fill(this->path.begin(), this->path.end(), unset);
+    this->jobs.clear();
+    this->jobs.push_back({ 0, 0, -1 });
+    while (!this->jobs.empty()) {
+        const job next = this->jobs.back();
+        this->jobs.pop_back();
+        if (next.tag >= 0) {
+            this->path[next.tag] = next.position;
+            continue;
+        }
+        const size_t state = next.state, position = next.position;
+        const size_t bit = position * states + state;
+        if ((this->visited[bit / 64] >> bit % 64) & 1) {
+            continue;
+        }
+        this->visited[bit / 64] |= uint64_t(1) << bit % 64;
+        const int tag = this->program->tag(state);
+        if (tag >= 0) {
+            this->jobs.push_back({ 0, this->path[tag], tag });
+            this->path[tag] = position;
+        }
+        const int counter = this->program->counter_at(state);
+        if (counter >= 0) {
+            // the longest run out of the counted bytes is tried first
+            const counted_repeat& repeat = this->program->counter(counter);
+            size_t run = 0;
+            while (run < repeat.max && position + run < input.size() &&
+                   repeat.classes[this->program->byte_class(
+                       input[position + run])]) {
+                ++run;
+            }
+            for (size_t count = repeat.min; count <= run; ++count) {
+                this->jobs.push_back({ state + 1, position + count, -1 });
+            }
+            continue;
+        }
+        if (position == input.size() &&
+            this->program->match(state) == match_state::ACCEPT) {
+            this->set_groups(input, this->path.data());
+            return true;
+        }
+        // pushed in reverse, so that byte transitions are tried first and
+        // epsilon transitions in their order
+        const auto e_range = this->program->e_transitions(state);
+        for (const uint32_t* it = e_range.second; it != e_range.first;) {
+            this->jobs.push_back({ *--it, position, -1 });
+        }
+        if (position < input.size()) {
+            const auto range = this->program->transitions(
+                state, this->program->byte_class(input[position]));
+            for (const uint32_t* it = range.second; it != range.first;) {
+                this->jobs.push_back({ *--it, position + 1, -1 });
+            }
+        }
+    }
+    return false;
+}
+
+// Leaves the threads that read all of input in following.
+void capture_finder::run_threads(std::string_view input)
+{
+    this->following.clear();
+    this->following_slots.clear();
+    std::fill(this->path.begin(), this->path.end(), unset);
+    ++this->generation;
+    this->follow(0, 0);
+    for (size_t i = 0; i < input.size() && !this->following.empty(); ++i) {
+        this->step(this->program->byte_class(input[i]), i + 1);
+    }
+}
+
+bool capture_finder::simulate(std::string_view input)
+{
+    this->run_threads(input);
+    for (const thread& last : this->following) {
+        if (this->program->match(last.state) == match_state::ACCEPT) {
+            this->set_groups(input,
+                             this->following_slots.data() + last.slots);
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t capture_finder::groups_closed(std::string_view input)
+{
+    this->run_threads(input);
+    size_t result = 0;
+    for (const thread& last : this->following) {
+        const size_t* slots = this->following_slots.data() + last.slots;
+        size_t closed = 0;
+        while (closed < this->groups.size() &&
+               slots[2 * closed + 1] != unset) {
+            ++closed;
+        }
+        result = std::max(result, closed);
+    }
+    return result;
+}
+
+void capture_finder::set_groups(std::string_view input, const size_t* slots)
+{
+    for (size_t i = 0; i < this->groups.size(); ++i) {
+        const size_t begin = slots[2 * i], end = slots[2 * i + 1];
+        this->groups[i] = begin == unset || end == unset || end < begin
+                              ? std::string_view()
+                              : input.substr(begin, end - begin);
+    }
+}
 }
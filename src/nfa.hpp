@@ -1,10 +1,28 @@
 #ifndef NFA_HPP_INCLUDED
 #define NFA_HPP_INCLUDED
 
+#include "scan.hpp"
+#include <bitset>
+#include <cstddef>
 #include <cstdint>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+// Counting statistics slows matching down, so it's only done if the whole
+// library is built with NSTR_STATS defined. Statements in NSTR_COUNT are left
+// out otherwise.
+#ifdef NSTR_STATS
+#define NSTR_COUNT(...) __VA_ARGS__
+#else
+#define NSTR_COUNT(...)
+#endif
+
 // ***************************************************************
 // NFA CONSTRUCTION & EXECUTION
 // ***************************************************************
@@ -22,6 +40,16 @@ struct nfa_state
     std::map<uint8_t, std::vector<int>> transitions;
     std::vector<int> e_transitions;
     match_state match;
+    // Set on the first state of a counted repetition. It stands for
+    // count_min to count_max bytes out of count_bytes, followed by the state
+    // after it. count_max is -1 if there's no upper bound.
+    bool counter = false;
+    std::bitset<256> count_bytes;
+    int count_min = 0;
+    int count_max = 0;
+    // Passing this state records the position in slot tag: 2 * i where
+    // group i starts and 2 * i + 1 where it ends. -1 for other states.
+    int tag = -1;
 
     nfa_state(std::map<uint8_t, std::vector<int>>&& transitions,
               std::vector<int>&& e_transitions,
@@ -32,18 +60,39 @@ class nfa
 {
     std::vector<nfa_state> states;
     std::vector<size_t> current;
+    size_t group_count = 0;
 
     static nfa concatenate(nfa&& lhs, nfa&& rhs);
     static nfa loop(nfa&& x);
     static nfa unite(nfa&& lhs, nfa&& rhs);
     static nfa repeat(nfa&& x, int min, int max);
-    static nfa parse_regex(const char* regex, size_t size);
+    static nfa count(nfa&& x, int min, int max);
+    static nfa group(nfa&& x, int index);
+    static nfa concatenate_all(std::vector<nfa>&& sequence);
+    static nfa parse_regex(const char* regex,
+                           size_t size,
+                           size_t& offset,
+                           size_t& groups,
+                           bool nested);
+
+    bool is_byte_set() const;
 
     nfa(uint8_t c);
     nfa(const std::vector<std::pair<uint8_t, uint8_t>>& ranges, bool negate);
     nfa();
 
   public:
+    // Repetitions of a single byte set with bounds above this are counted
+    // instead of copying the states of the repeated part. Below it, copies
+    // are cheaper since they can be run as a DFA. Only byte sets are counted:
+    // a counter entry only has to know where it entered, as every byte moves
+    // it one step, but a group can be halfway through several repetitions at
+    // once, each in states of its own. Groups with larger bounds are rejected.
+    static const size_t max_unrolled = 256;
+    // Repetitions that aren't counted take at most this many states once
+    // copied.
+    static const size_t max_unrolled_states = 1 << 16;
+
     nfa(const std::string& regex);
     nfa(nfa&& other);
     nfa& operator=(nfa&& other);
@@ -51,8 +100,11 @@ class nfa
     nfa& operator=(const nfa& other) = default;
 
     const std::vector<nfa_state>& get_states() const;
+    size_t get_group_count() const { return this->group_count; }
 };
 
+class nfa_program;
+
 struct nfa_cursor
 {
     size_t index;
@@ -61,27 +113,524 @@ struct nfa_cursor
     nfa_cursor(size_t index, size_t count);
 };
 
+// Where and with what count a cursor entered a counted repetition.
+struct counter_entry
+{
+    size_t position;
+    size_t count;
+};
+
+// FIFO of counter entries that also allows indexing, for the entries of a
+// counted repetition.
+class entry_queue
+{
+    std::vector<counter_entry> entries;
+    size_t head = 0;
+
+  public:
+    bool empty() const { return this->head == this->entries.size(); }
+    size_t size() const { return this->entries.size() - this->head; }
+    counter_entry& operator[](size_t i)
+    {
+        return this->entries[this->head + i];
+    }
+    const counter_entry& operator[](size_t i) const
+    {
+        return this->entries[this->head + i];
+    }
+    const counter_entry& front() const { return this->entries[this->head]; }
+    const counter_entry& back() const { return this->entries.back(); }
+    void push_back(const counter_entry& entry);
+    void pop_front();
+    void pop_back() { this->entries.pop_back(); }
+    void clear();
+};
+
+// The entries a counted repetition holds, oldest first. The ones that went
+// through at least the minimum number of bytes are promoted, and best keeps
+// the promoted ones that can still give the longest match when leaving, so
+// leaving doesn't have to look at every entry.
+struct counter_run
+{
+    entry_queue entries;
+    entry_queue best;
+    size_t promoted = 0;
+
+    bool empty() const { return this->entries.empty(); }
+    void clear();
+};
+
+// Cursors of an NFA step, in groups of the ones reached from the same start,
+// earliest start first. A group holds each state at most once, and is dropped
+// when it's closed if all its states are in earlier groups, so there are never
+// more groups than states. States are stamped with the group and the set
+// holding them, which makes insertion, lookup and clearing O(1).
+class cursor_set
+{
+    std::vector<nfa_cursor> cursors;
+    std::vector<size_t> group_stamps;
+    std::vector<size_t> set_stamps;
+    size_t group_stamp;
+    size_t set_stamp;
+    size_t group_begin;
+    size_t group_count;
+    bool group_open;
+    bool group_fresh;
+
+  public:
+    cursor_set(size_t capacity);
+
+    bool contains(size_t index, size_t count) const;
+    bool holds(size_t index) const;
+    void insert(size_t index, size_t count);
+    void close_group();
+    void retain_count(size_t count);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+    std::vector<nfa_cursor>::const_iterator begin() const;
+    std::vector<nfa_cursor>::const_iterator end() const;
+};
+
+struct dfa_transition
+{
+    int target;
+    int survivors;
+
+    dfa_transition(int target, int survivors);
+};
+
+// A DFA state is an ordered list of groups of NFA states. Every group holds
+// all the NFA states reached from one start_path() call, earliest start first,
+// so trimming to one start keeps the states it shares with earlier ones. A
+// group only lives on while it has a state no earlier group has, which keeps
+// the number of groups below the number of NFA states.
+struct dfa_state
+{
+    std::vector<size_t> groups;
+    size_t group_count;
+    std::vector<dfa_transition> transitions;
+    dfa_transition with_start;
+    match_state match;
+    int accept_group;
+
+    dfa_state(std::vector<size_t>&& groups, const nfa_program& program);
+};
+
+class lazy_dfa
+{
+    std::vector<dfa_state> states;
+    std::map<std::vector<size_t>, int> index;
+    std::vector<std::vector<size_t>> survivor_lists;
+    std::map<std::vector<size_t>, int> survivor_index;
+
+    static void add_closure(const nfa_program& program,
+                            size_t state,
+                            std::vector<bool>& seen,
+                            std::vector<size_t>& group);
+    static bool close_group(std::vector<bool>& covered,
+                            std::vector<size_t>& groups,
+                            size_t begin);
+    int add_survivors(std::vector<size_t>&& survivors);
+
+  public:
+    static const size_t group_end = static_cast<size_t>(-1);
+    static const size_t max_states = 1000;
+
+    void clear();
+    bool full() const;
+    int intern(const nfa_program& program, std::vector<size_t>&& groups);
+    dfa_transition next(const nfa_program& program, int from, size_t cls);
+    dfa_transition start_path(const nfa_program& program, int from);
+    int select_group(const nfa_program& program, int from, size_t group);
+
+    const dfa_state& operator[](int state) const;
+    const std::vector<size_t>& survivors(int list) const;
+};
+
+// Finds what the groups of a regex matched, once an executor found where the
+// match ends. The NFA is run again over the matched bytes only, trying the
+// earlier alternative and the longer repetition first, as in Perl. One-pass
+// programs use their table. Otherwise short inputs are backtracked with every
+// state and position visited at most once, and longer ones are simulated with
+// threads that carry their own group boundaries, kept in order of priority so
+// the first to reach a state wins it.
+class capture_finder
+{
+    struct thread
+    {
+        size_t state;
+        size_t count;
+        size_t slots;
+    };
+
+    // Backtracking goes on at state and position, or puts position back to
+    // slot tag if tag isn't negative.
+    struct job
+    {
+        size_t state;
+        size_t position;
+        int tag;
+    };
+
+    const nfa_program* program;
+    std::vector<bool> consumes;
+    std::vector<thread> current;
+    std::vector<thread> following;
+    std::vector<size_t> current_slots;
+    std::vector<size_t> following_slots;
+    std::vector<size_t> path;
+    std::vector<size_t> marks;
+    std::vector<size_t> counter_marks;
+    size_t generation;
+    std::vector<uint64_t> visited;
+    std::vector<job> jobs;
+    std::vector<std::string_view> groups;
+
+    bool run_one_pass(std::string_view input);
+    bool backtrack(std::string_view input);
+    bool simulate(std::string_view input);
+    void run_threads(std::string_view input);
+    void set_groups(std::string_view input, const size_t* slots);
+    void add_thread(size_t state, size_t count);
+    void follow(size_t state, size_t position);
+    void step(size_t cls, size_t position);
+
+  public:
+    static const size_t unset = static_cast<size_t>(-1);
+    // Inputs are backtracked if every state at every position takes at most
+    // this many bits.
+    static const size_t max_visited = 1 << 18;
+
+    capture_finder(const nfa_program& program);
+
+    size_t group_count() const { return this->groups.size(); }
+    // Tells if the regex matches all of input, and sets the groups if so.
+    bool find(std::string_view input);
+    // What group index matched in the last input found, or an empty view if
+    // it didn't take part in the match.
+    std::string_view group(size_t index) const
+    {
+        return this->groups[index];
+    }
+    // How many groups, counted from the first, the furthest way of matching
+    // input as a prefix got through. Tells where input stopped matching.
+    size_t groups_closed(std::string_view input);
+};
+
+// Scratch space for matching against a program: the lazy DFA cache, the
+// NFA cursor sets and the capture threads. Only one executor uses a scratch
+// object at a time.
+struct nfa_scratch
+{
+    lazy_dfa dfa;
+    cursor_set current;
+    cursor_set following;
+    std::vector<size_t> stack;
+    std::vector<std::pair<size_t, size_t>> exits;
+    capture_finder captures;
+    // Bytes the DFA cache has seen since it was last cleared, by the
+    // executors that used the scratch before.
+    size_t scanned = 0;
+
+    nfa_scratch(const nfa_program& program);
+};
+
+// A counted repetition in a program. It's left at the state after it.
+struct counted_repeat
+{
+    size_t state;
+    std::vector<bool> classes;
+    size_t min;
+    size_t max;
+};
+
+// Most regexes with groups, like those of record formats, are one-pass: at
+// any position at most one thread can read the next byte. Their groups are
+// then found with one lookup per byte. A node stands for the states reached
+// after a byte, and an action tells the node after the next byte, or -1, and
+// the slots to record before it.
+struct one_pass_table
+{
+    struct action
+    {
+        int next;
+        uint32_t tags_begin;
+        uint32_t tags_end;
+    };
+
+    std::vector<action> steps;
+    std::vector<action> accepts;
+    std::vector<int> tags;
+
+    bool empty() const { return this->steps.empty(); }
+};
+
+// Immutable compiled regex, safe to share between threads. Bytes that no
+// transition tells apart share a byte class, and the transitions are stored
+// in flat arrays: the targets of state s on class c are
+// targets[offsets[s * class_count + c]] up to the next offset. Scratch space
+// released by executors is pooled, so later executors of the same program
+// start with a warm DFA cache.
+class nfa_program
+{
+    uint8_t byte_classes[256];
+    size_t class_count;
+    std::vector<match_state> matches;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> targets;
+    std::vector<uint32_t> e_offsets;
+    std::vector<uint32_t> e_targets;
+    std::vector<counted_repeat> counters;
+    std::vector<int> counter_indices;
+    std::vector<int> tags;
+    std::vector<uint32_t> start_states;
+    size_t group_count;
+    one_pass_table one_pass;
+    byte_scanner scanner;
+    mutable std::mutex lock;
+    mutable std::vector<std::unique_ptr<nfa_scratch>> pool;
+#ifdef NSTR_STATS
+    std::string pattern;
+#endif
+
+    void compute_byte_classes(const std::vector<nfa_state>& states);
+    void compute_scanner();
+    void compute_start_states();
+    void compute_one_pass();
+
+  public:
+    typedef std::pair<const uint32_t*, const uint32_t*> target_range;
+
+    static const size_t max_pooled = 8;
+
+    nfa_program(const std::string& regex);
+
+    size_t size() const { return this->matches.size(); }
+    size_t get_class_count() const { return this->class_count; }
+    size_t byte_class(uint8_t symbol) const
+    {
+        return this->byte_classes[symbol];
+    }
+    match_state match(size_t state) const { return this->matches[state]; }
+    // Tells if state reads a byte, accepts or enters a counted repetition,
+    // unlike the states that only lead on to others.
+    bool reads(size_t state) const
+    {
+        const size_t i = state * this->class_count;
+        return this->offsets[i] != this->offsets[i + this->class_count] ||
+               this->matches[state] == match_state::ACCEPT ||
+               this->counter_at(state) >= 0;
+    }
+    target_range transitions(size_t state, size_t cls) const
+    {
+        const uint32_t* base = this->targets.data();
+        const size_t i = state * this->class_count + cls;
+        return { base + this->offsets[i], base + this->offsets[i + 1] };
+    }
+    target_range e_transitions(size_t state) const
+    {
+        const uint32_t* base = this->e_targets.data();
+        return { base + this->e_offsets[state],
+                 base + this->e_offsets[state + 1] };
+    }
+
+    // Counted repetitions can't be turned into a DFA, so programs that have
+    // any are only run as an NFA.
+    bool has_counters() const { return !this->counters.empty(); }
+    size_t counter_count() const { return this->counters.size(); }
+    const counted_repeat& counter(size_t index) const
+    {
+        return this->counters[index];
+    }
+    // The counted repetition starting at state, or -1.
+    int counter_at(size_t state) const
+    {
+        return this->counter_indices.empty() ? -1
+                                             : this->counter_indices[state];
+    }
+
+    // Capturing groups and the slot each state records, see nfa_state::tag.
+    size_t get_group_count() const { return this->group_count; }
+    int tag(size_t state) const
+    {
+        return this->tags.empty() ? -1 : this->tags[state];
+    }
+    // Steps are indexed by node * class count + class, and accepts by node.
+    // Empty if the program isn't one-pass.
+    const one_pass_table& get_one_pass() const { return this->one_pass; }
+
+    // The states a new path reads a byte or accepts in.
+    const std::vector<uint32_t>& get_start_states() const
+    {
+        return this->start_states;
+    }
+
+    // Finds the bytes a match can start with.
+    const byte_scanner& get_scanner() const { return this->scanner; }
+
+    std::unique_ptr<nfa_scratch> acquire() const;
+    void release(std::unique_ptr<nfa_scratch>&& scratch) const;
+
+#ifdef NSTR_STATS
+    const std::string& get_pattern() const { return this->pattern; }
+#endif
+};
+
+struct nfa_cache_stats
+{
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t size;
+    size_t capacity;
+};
+
+// Process-wide cache of compiled regexes keyed by pattern. Least recently used
+// entries are evicted once the cache holds more than capacity patterns.
+class nfa_cache
+{
+    typedef std::pair<std::string, std::shared_ptr<const nfa_program>> entry;
+
+    std::mutex lock;
+    std::list<entry> entries;
+    std::unordered_map<std::string, std::list<entry>::iterator> index;
+    nfa_cache_stats stats;
+
+    nfa_cache();
+    void shrink();
+    static nfa_cache& instance();
+
+  public:
+    static const size_t default_capacity = 256;
+
+    static std::shared_ptr<const nfa_program> get(const std::string& regex);
+    static void set_capacity(size_t capacity);
+    static void clear();
+    static nfa_cache_stats get_stats();
+};
+
+// What executors did while matching. Active states are the NFA states an
+// executor was in after a byte, and closure expansions count how often the
+// states reachable by epsilon transitions were collected, either for an NFA
+// step or for a new DFA transition.
+struct nfa_counters
+{
+    size_t bytes_scanned = 0;
+    size_t bytes_skipped = 0;
+    size_t active_total = 0;
+    size_t active_peak = 0;
+    size_t closure_expansions = 0;
+    size_t bytes_put_back = 0;
+
+    bool empty() const;
+    void add(const nfa_counters& other);
+};
+
+// The counters of all executors of a pattern, and what compiling it took.
+struct nfa_stats : nfa_counters
+{
+    std::string pattern;
+    size_t states = 0;
+    size_t byte_classes = 0;
+    size_t compilations = 0;
+    double compile_seconds = 0;
+    size_t executors = 0;
+
+    double average_active() const;
+};
+
+// Process-wide statistics keyed by pattern. Programs add themselves when
+// they're compiled, and executors add their counters when they're destroyed.
+class nfa_stats_registry
+{
+    std::mutex lock;
+    std::map<std::string, nfa_stats> patterns;
+
+    static nfa_stats_registry& instance();
+
+  public:
+    static void add_program(const std::string& pattern,
+                            size_t states,
+                            size_t byte_classes,
+                            double compile_seconds);
+    static void add_counters(const std::string& pattern,
+                             const nfa_counters& counters);
+    static std::vector<nfa_stats> get();
+    static void clear();
+};
+
+// Runs a program as a lazily built DFA and falls back to simulating the NFA
+// when the DFA cache keeps overflowing. NFA cursors are kept in groups of
+// decreasing count, one per start, like the groups of a DFA state. Cursors
+// entering a counted repetition are kept as entries of the counter instead,
+// with the position they entered at. Only the longest match leaving a counter
+// goes on, into the group of its start, as stepping every start in a long
+// counter would take a step per entry.
+// Copying an executor shares the program and only copies the active states.
 class nfa_executor
 {
-    nfa state_machine;
-    std::vector<nfa_cursor> current;
+    std::shared_ptr<const nfa_program> program;
+    std::unique_ptr<nfa_scratch> scratch;
+    bool use_dfa;
+    int dfa_current;
+    std::vector<size_t> starts;
+    size_t position;
+    size_t flush_position;
+    std::vector<counter_run> counters;
+#ifdef NSTR_STATS
+    nfa_counters stats;
 
-    void transition_to(const nfa_cursor& cursor,
-                       int offset,
-                       std::vector<nfa_cursor>& index_set);
-    void add_successor_states(uint8_t symbol,
-                              const nfa_cursor& cursor,
-                              std::vector<nfa_cursor>& index_set);
+    void count_active();
+    void flush_stats();
+#endif
+
+    bool make_room();
+    void leave_dfa();
+    void release_scratch();
+
+    void add_closure(size_t index, size_t count, cursor_set& cursors);
+    bool start_covered() const;
+    void enter_counter(size_t state, size_t count);
+    void advance_counters(size_t cls);
+    void promote(counter_run& run, const counted_repeat& counter);
 
   public:
     nfa_executor(const std::string& regex);
+    nfa_executor(const nfa_executor& other);
+    nfa_executor(nfa_executor&& other);
+    nfa_executor& operator=(const nfa_executor& other);
+    nfa_executor& operator=(nfa_executor&& other);
+    ~nfa_executor();
 
     void reset();
     void start_path();
     void next(uint8_t symbol);
     match_state match() const;
     size_t longest_match() const;
+    // Tells if the executor still runs the lazy DFA rather than the NFA.
+    bool uses_dfa() const { return this->use_dfa; }
     size_t trim_short_matches();
+
+    // An idle executor only holds the path started at the current position.
+    // Feeding it a byte the scanner doesn't find and starting a new path
+    // leaves it idle, so skip(count) can stand in for count such steps.
+    bool idle() const;
+    void skip(size_t count);
+    const byte_scanner& scanner() const;
+
+    // What the groups matched in input, which has to be a whole match of the
+    // regex, like the bytes read_pattern found.
+    bool find_groups(std::string_view input);
+    size_t group_count() const;
+    std::string_view group(size_t index) const;
+    size_t groups_closed(std::string_view input);
+
+#ifdef NSTR_STATS
+    // Manipulators tell how many of the bytes they fed the executor went
+    // back to the input.
+    void count_put_back(size_t count);
+#endif
 };
 }
 #endif
@@ -1,6 +1,8 @@
 #include "nicein.hpp"
+#include <algorithm>
 #include <cctype>
 #include <cstdint>
+#include <iterator>
 #include <map>
 #include <string>
 #include <vector>
@@ -12,13 +14,46 @@ namespace nstr {
 // STREAM STUFF
 // *************************************************************
 
-sep::sep(const std::string& regex)
-    : rx(regex, dummy)
-{}
+void set_regex_cache_capacity(size_t capacity)
+{
+    nfa_cache::set_capacity(capacity);
+}
+
+void clear_regex_cache()
+{
+    nfa_cache::clear();
+}
+
+regex_cache_stats get_regex_cache_stats()
+{
+    return nfa_cache::get_stats();
+}
+
+std::vector<regex_stats> get_regex_stats()
+{
+    return nfa_stats_registry::get();
+}
+
+void clear_regex_stats()
+{
+    nfa_stats_registry::clear();
+}
 
-std::istream& operator>>(std::istream& is, sep what)
+void dump_regex_stats(std::ostream& os)
 {
-    return is >> what.rx;
+    for (const regex_stats& stats : get_regex_stats()) {
+        os << stats.pattern << ": states=" << stats.states
+           << " classes=" << stats.byte_classes
+           << " compilations=" << stats.compilations
+           << " compile_us=" << stats.compile_seconds * 1e6
+           << " executors=" << stats.executors
+           << " scanned=" << stats.bytes_scanned
+           << " skipped=" << stats.bytes_skipped
+           << " active_avg=" << stats.average_active()
+           << " active_peak=" << stats.active_peak
+           << " closures=" << stats.closure_expansions
+           << " put_back=" << stats.bytes_put_back << '\n';
+    }
 }
 
 std::istream& operator>>(std::istream& is, skip<>)
@@ -26,62 +61,80 @@ std::istream& operator>>(std::istream& is, skip<>)
     return is;
 }
 
-until::until(const std::string& regex, std::string& dst)
-    : nfa(regex)
-    , dst(dst)
-{}
+source& operator>>(source& src, skip<>)
+{
+    return src;
+}
 
-until::until(const std::string& regex)
-    : nfa(regex)
-    , dst(this->dummy)
+all::all(std::string& dst)
+    : dst(dst)
 {}
 
-std::istream& operator>>(std::istream& is, until obj)
+std::istream& operator>>(std::istream& is, all obj)
+{
+    stream_reader reader(is);
+    obj.read(reader);
+    is.setstate(std::ios::failbit);
+    return is;
+}
+
+source& operator>>(source& src, all obj)
 {
-    while (obj.nfa.match() != match_state::ACCEPT) {
-        if (is.eof()) {
-            throw invalid_input();
+    obj.read(src);
+    return src;
+}
+
+namespace {
+
+// The regex of a format spec: fields named in braces turn into groups, and
+// the line ends with '\n'.
+std::string format_regex(const std::string& spec)
+{
+    static const std::pair<std::string_view, std::string_view> fields[] = {
+        { "{int}", "([+\\-]?\\d+)" },
+        { "{float}",
+          "([+\\-]?(?:\\d+(?:\\.\\d*)?|\\.\\d+)(?:[eE][+\\-]?\\d+)?)" },
+        { "{str}", "(\\S+)" },
+    };
+    std::string regex = "(?:";
+    for (size_t i = 0; i < spec.size(); ++i) {
+        if (spec[i] == '\\' && i + 1 < spec.size()) {
+            regex.append(spec, i++, 2);
+            continue;
         }
-        uint8_t sym = is.get();
-        obj.nfa.next(sym);
-        obj.nfa.start_path();
-        obj.dst.push_back(sym);
-    }
-    const size_t len = obj.nfa.trim_short_matches();
-    obj.dst.resize(obj.dst.size() - len);
-    std::vector<uint8_t> buf;
-    while (true) {
-        uint8_t next = static_cast<uint8_t>(is.get());
-        if (is.eof()) {
-            is.clear();
-            break;
+        // other braces are repetitions
+        if (spec[i] != '{' || i + 1 == spec.size() ||
+            !std::isalpha(static_cast<unsigned char>(spec[i + 1]))) {
+            regex.push_back(spec[i]);
+            continue;
         }
-        buf.push_back(next);
-        obj.nfa.next(next);
-        if (obj.nfa.match() == match_state::ACCEPT) {
-            buf.clear();
-        } else if (obj.nfa.match() == match_state::REFUSE) {
-            break;
+        const std::string_view rest = std::string_view(spec).substr(i);
+        const auto* field = std::find_if(
+            std::begin(fields), std::end(fields), [&](const auto& field) {
+                return rest.substr(0, field.first.size()) == field.first;
+            });
+        if (field == std::end(fields)) {
+            throw invalid_regex();
         }
+        regex.append(field->second);
+        i += field->first.size() - 1;
     }
-    for (size_t i = buf.size(); i > 0; --i) {
-        is.putback(buf[i - 1]);
-    }
-    return is;
+    return regex + ")\n";
+}
 }
 
-all::all(std::string& dst)
-    : dst(dst)
+format::format(const std::string& spec)
+    : nfa(format_regex(spec))
+    , started(false)
+    , ended(false)
 {}
 
-std::istream& operator>>(std::istream& is, all obj)
+void format::restart()
 {
-    char c = is.get();
-    while (is.good()) {
-        obj.dst.push_back(c);
-        c = is.get();
-    }
-    return is;
+    this->nfa.reset();
+    this->line.clear();
+    this->started = false;
+    this->ended = false;
 }
 
 template<>
@@ -89,4 +142,33 @@ void read_from_string(std::string&& src, std::string& obj)
 {
     obj = std::move(src);
 }
+
+char read_char(source& src)
+{
+    std::string result;
+    if (!scan_value<char>(src, result, true)) {
+        throw invalid_input();
+    }
+    return result[0];
+}
+
+std::string read_token(source& src)
+{
+    std::string token;
+    if (!scan_value<std::string>(src, token, true)) {
+        throw invalid_input();
+    }
+    return token;
+}
+
+std::string read_number(source& src, bool floating)
+{
+    std::string number;
+    const bool found = floating ? scan_value<double>(src, number, true)
+                                : scan_value<long>(src, number, true);
+    if (!found) {
+        throw invalid_input();
+    }
+    return number;
+}
 }
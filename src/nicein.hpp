@@ -1,11 +1,18 @@
 #ifndef NICEIN_HPP_INCLUDED
 #define NICEIN_HPP_INCLUDED
 
+#include "convert.hpp"
 #include "nfa.hpp"
+#include "source.hpp"
+#include "static_nfa.hpp"
 #include <iostream>
 #include <iterator>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 namespace nstr {
 
@@ -16,226 +23,1522 @@ struct stream_error : public std::exception
 struct invalid_regex : public std::exception
 {};
 
+// Thrown when a line doesn't fit a format. field is the first field that
+// couldn't be read, the text in front of it included, or the number of fields
+// if the line goes on after the last one.
+struct invalid_field : public invalid_input
+{
+    size_t field;
+
+    explicit invalid_field(size_t field)
+        : field(field)
+    {}
+};
+
+typedef nstr_private::nfa_cache_stats regex_cache_stats;
+
+void set_regex_cache_capacity(size_t capacity);
+void clear_regex_cache();
+regex_cache_stats get_regex_cache_stats();
+
+typedef nstr_private::nfa_stats regex_stats;
+
+#ifdef NSTR_STATS
+constexpr bool regex_stats_enabled = true;
+#else
+constexpr bool regex_stats_enabled = false;
+#endif
+
+// Statistics of the regex engine per pattern, sorted by pattern. They're only
+// kept if the library is built with NSTR_STATS defined, regexes compiled into
+// the executable with NSTR_RX aren't counted.
+std::vector<regex_stats> get_regex_stats();
+void clear_regex_stats();
+void dump_regex_stats(std::ostream& os);
+
 template<typename... Fields>
 class skip
 {
 };
 
+// Strings and characters are skipped by only finding where they end. Decimal
+// numbers are checked without keeping the value, so skipping fails where
+// reading would. Anything else is read.
 template<typename First, typename... Rest>
 std::istream& operator>>(std::istream& is, skip<First, Rest...>)
 {
-    First f;
-    is >> f;
+    const bool skip_ws = bool(is.flags() & std::ios::skipws);
+    const bool decimal = (is.flags() & std::ios::basefield) == std::ios::dec;
+    bool checked = false;
+    if constexpr (std::is_same_v<First, bool>) {
+        checked = decimal && !(is.flags() & std::ios::boolalpha);
+    } else if constexpr (std::is_floating_point_v<First>) {
+        checked = nstr_private::parses_floating_v<First>;
+    } else if constexpr (std::is_integral_v<First>) {
+        checked = decimal && !nstr_private::is_char_v<First>;
+    }
+    if constexpr (std::is_same_v<First, std::string> ||
+                  (std::is_integral_v<First> && sizeof(First) == 1 &&
+                   !std::is_same_v<First, bool>)) {
+        nstr_private::stream_reader reader(is);
+        nstr_private::item_skipper skipped;
+        if (!nstr_private::scan_value<First>(reader, skipped, skip_ws)) {
+            is.setstate(std::ios::failbit);
+        }
+    } else if (checked) {
+        nstr_private::stream_reader reader(is);
+        std::string token;
+        if (!nstr_private::scan_value<First>(reader, token, skip_ws) ||
+            !nstr_private::parses_as<First>(token.data(),
+                                            token.data() + token.size())) {
+            is.setstate(std::ios::failbit);
+        }
+    } else {
+        First f;
+        is >> f;
+    }
     return is >> skip<Rest...>();
 }
 
 std::istream& operator>>(std::istream& is, skip<>);
 
+// Every value is a token on a source, the type doesn't matter.
+template<typename First, typename... Rest>
+source& operator>>(source& src, skip<First, Rest...>)
+{
+    nstr_private::item_skipper skipped;
+    if (!nstr_private::scan_value<First>(src, skipped, true)) {
+        throw invalid_input();
+    }
+    return src >> skip<Rest...>();
+}
+
+source& operator>>(source& src, skip<>);
+
+// Skips count whitespace delimited tokens.
+template<size_t Count>
+class skip_n_t
+{
+    template<size_t C>
+    friend std::istream& operator>>(std::istream&, skip_n_t<C>);
+    template<size_t C>
+    friend source& operator>>(source&, skip_n_t<C>);
+
+    template<typename Reader>
+    static bool read(Reader& reader);
+};
+
+template<size_t Count>
+template<typename Reader>
+bool skip_n_t<Count>::read(Reader& reader)
+{
+    nstr_private::item_skipper skipped;
+    for (size_t i = 0; i < Count; ++i) {
+        if (!nstr_private::scan_value<std::string>(reader, skipped, true)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<size_t Count>
+std::istream& operator>>(std::istream& is, skip_n_t<Count>)
+{
+    nstr_private::stream_reader reader(is);
+    if (!skip_n_t<Count>::read(reader)) {
+        is.setstate(std::ios::failbit);
+    }
+    return is;
+}
+
+template<size_t Count>
+source& operator>>(source& src, skip_n_t<Count>)
+{
+    if (!skip_n_t<Count>::read(src)) {
+        throw invalid_input();
+    }
+    return src;
+}
+
+template<size_t Count>
+skip_n_t<Count> skip_n()
+{
+    return {};
+}
+
+}
+
+namespace nstr_private {
+
+// How far read_until got before a push_source ran out of input.
+struct until_progress
+{
+    bool matched = false;
+    size_t pending = 0;
+};
+
+// Moves the input in front of the first match of the regex to dst, and
+// skips the longest match there. Returns false if the input ran out before
+// that, but more may still come.
+template<typename Reader, typename Executor, typename Dst>
+bool read_until(Reader& reader,
+                Executor& nfa,
+                Dst& dst,
+                until_progress& progress)
+{
+    const byte_scanner& scanner = nfa.scanner();
+    uint8_t sym;
+    while (!progress.matched && nfa.match() != match_state::ACCEPT) {
+        if (nfa.idle()) {
+            const size_t skipped =
+                skip_to_candidate(reader, dst, scanner, scanner);
+            if (skipped > 0) {
+                nfa.skip(skipped);
+                continue;
+            }
+        }
+        if (!reader.next(sym)) {
+            if (reader.suspended()) {
+                return false;
+            }
+            reader.set_eof();
+            throw nstr::invalid_input();
+        }
+        nfa.next(sym);
+        nfa.start_path();
+        dst.push_back(sym);
+    }
+    if (!progress.matched) {
+        progress.matched = true;
+        const size_t len = nfa.trim_short_matches();
+        dst.resize(dst.size() - len);
+        reader.set_mark();
+    }
+    while (reader.next(sym)) {
+        ++progress.pending;
+        nfa.next(sym);
+        if (nfa.match() == match_state::ACCEPT) {
+            reader.set_mark();
+            progress.pending = 0;
+        } else if (nfa.match() == match_state::REFUSE) {
+            break;
+        }
+    }
+    if (nfa.match() != match_state::REFUSE && reader.suspended()) {
+        return false;
+    }
+    NSTR_COUNT(nfa.count_put_back(progress.pending);)
+    reader.unread(progress.pending);
+    return true;
+}
+
+template<typename Reader, typename Executor, typename Dst>
+void read_until(Reader& reader, Executor& nfa, Dst& dst)
+{
+    until_progress progress;
+    if (!read_until(reader, nfa, dst, progress)) {
+        throw nstr::invalid_input();
+    }
+}
+
+// How far read_pattern got before a push_source ran out of input.
+struct pattn_progress
+{
+    std::string bytes;
+    size_t pending = 0;
+    bool started = false;
+    bool valid = false;
+};
+
+// Moves the longest prefix of the input that matches the regex to
+// progress.bytes, and tells in progress.valid if there was one. Returns false
+// if the input ran out before the regex refused it, but more may still come.
+template<typename Reader, typename Executor>
+bool read_pattern(Reader& reader, Executor& nfa, pattn_progress& progress)
+{
+    if (!progress.started) {
+        progress.started = true;
+        progress.valid = nfa.match() == match_state::ACCEPT;
+        reader.set_mark();
+    }
+    uint8_t next;
+    while (reader.next(next)) {
+        progress.bytes.push_back(next);
+        ++progress.pending;
+        nfa.next(next);
+        if (nfa.match() == match_state::ACCEPT) {
+            progress.valid = true;
+            reader.set_mark();
+            progress.pending = 0;
+        } else if (nfa.match() == match_state::REFUSE) {
+            break;
+        }
+    }
+    if (nfa.match() != match_state::REFUSE && reader.suspended()) {
+        return false;
+    }
+    NSTR_COUNT(nfa.count_put_back(progress.pending);)
+    reader.unread(progress.pending);
+    progress.bytes.resize(progress.bytes.size() - progress.pending);
+    return true;
+}
+}
+
+namespace nstr {
+
+// Continues reading manip from a push_source where it stopped the last time.
+// Returns true once manip is done, false if it needs more input first. Works
+// with until, pattn, match, format, sep and split.
+template<typename Manipulator>
+bool resume(push_source& in, Manipulator& manip)
+{
+    bool done;
+    try {
+        done = manip.resume_read(in);
+    } catch (...) {
+        manip.restart();
+        throw;
+    }
+    if (done) {
+        manip.restart();
+    }
+    return done;
+}
+
+template<typename Executor = nstr_private::nfa_executor>
 class until
 {
-    friend std::istream& operator>>(std::istream&, until);
-    nstr_private::nfa_executor nfa;
+    template<typename E>
+    friend std::istream& operator>>(std::istream&, until<E>);
+    template<typename E>
+    friend source& operator>>(source&, until<E>);
+    template<typename M>
+    friend bool resume(push_source&, M&);
+    Executor nfa;
     std::string& dst;
     std::string dummy;
+    nstr_private::until_progress progress;
+
+    template<typename Reader>
+    void read(Reader& reader);
+    bool resume_read(push_source& in);
+    void restart();
 
   public:
     until(const std::string& regex, std::string& dst);
     until(const std::string& regex);
+    template<typename Source>
+    until(static_regex<Source> regex, std::string& dst);
+    template<typename Source>
+    until(static_regex<Source> regex);
 };
 
-std::istream& operator>>(std::istream& is, until obj);
+template<typename Source>
+until(static_regex<Source>, std::string&)
+    -> until<nstr_private::static_executor<Source>>;
+template<typename Source>
+until(static_regex<Source>) -> until<nstr_private::static_executor<Source>>;
+
+template<typename Executor>
+until<Executor>::until(const std::string& regex, std::string& dst)
+    : nfa(regex)
+    , dst(dst)
+{}
+
+template<typename Executor>
+until<Executor>::until(const std::string& regex)
+    : nfa(regex)
+    , dst(this->dummy)
+{}
+
+template<typename Executor>
+template<typename Source>
+until<Executor>::until(static_regex<Source> regex, std::string& dst)
+    : nfa(regex)
+    , dst(dst)
+{}
+
+template<typename Executor>
+template<typename Source>
+until<Executor>::until(static_regex<Source> regex)
+    : nfa(regex)
+    , dst(this->dummy)
+{}
+
+template<typename Executor>
+template<typename Reader>
+void until<Executor>::read(Reader& reader)
+{
+    nstr_private::read_until(reader, this->nfa, this->dst);
+}
+
+template<typename Executor>
+bool until<Executor>::resume_read(push_source& in)
+{
+    return nstr_private::read_until(in, this->nfa, this->dst, this->progress);
+}
+
+template<typename Executor>
+void until<Executor>::restart()
+{
+    this->nfa.reset();
+    this->progress = {};
+}
+
+template<typename Executor>
+std::istream& operator>>(std::istream& is, until<Executor> obj)
+{
+    nstr_private::stream_reader reader(is);
+    obj.read(reader);
+    return is;
+}
+
+template<typename Executor>
+source& operator>>(source& src, until<Executor> obj)
+{
+    obj.read(src);
+    return src;
+}
+
+// Skips past count matches of a regex.
+template<size_t Count, typename Executor>
+class skip_until_t
+{
+    template<size_t C, typename E>
+    friend std::istream& operator>>(std::istream&, skip_until_t<C, E>);
+    template<size_t C, typename E>
+    friend source& operator>>(source&, skip_until_t<C, E>);
+    Executor nfa;
+
+    template<typename Reader>
+    void read(Reader& reader);
+
+  public:
+    template<typename Rx>
+    skip_until_t(const Rx& rx);
+};
+
+template<size_t Count, typename Executor>
+template<typename Rx>
+skip_until_t<Count, Executor>::skip_until_t(const Rx& rx)
+    : nfa(rx)
+{}
+
+template<size_t Count, typename Executor>
+template<typename Reader>
+void skip_until_t<Count, Executor>::read(Reader& reader)
+{
+    nstr_private::item_skipper skipped;
+    for (size_t i = 0; i < Count; ++i) {
+        if (i > 0) {
+            this->nfa.reset();
+        }
+        nstr_private::read_until(reader, this->nfa, skipped);
+    }
+}
+
+template<size_t Count, typename Executor>
+std::istream& operator>>(std::istream& is, skip_until_t<Count, Executor> obj)
+{
+    nstr_private::stream_reader reader(is);
+    obj.read(reader);
+    return is;
+}
+
+template<size_t Count, typename Executor>
+source& operator>>(source& src, skip_until_t<Count, Executor> obj)
+{
+    obj.read(src);
+    return src;
+}
+
+template<size_t Count, typename Rx>
+skip_until_t<Count, nstr_private::executor_type_t<Rx>> skip_n(const Rx& rx)
+{
+    return skip_until_t<Count, nstr_private::executor_type_t<Rx>>(rx);
+}
 
 template<typename T>
-void read_from_string(std::string&& src, T& obj)
+void read_from_view(std::string_view src, T& obj)
 {
-    std::stringstream ss(std::move(src));
-    ss >> obj;
-    ss.get();
-    if (!ss.eof()) {
-        throw invalid_input();
+    const char* begin = src.data();
+    const char* end = begin + src.size();
+    if constexpr (std::is_same_v<T, std::string_view>) {
+        obj = src;
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        obj.assign(begin, end);
+    } else if constexpr (nstr_private::parses_integer_v<T>) {
+        if (!nstr_private::parse_integer(begin, end, obj)) {
+            throw invalid_input();
+        }
+    } else if constexpr (nstr_private::parses_floating_v<T>) {
+        if (!nstr_private::parse_floating(begin, end, obj)) {
+            throw invalid_input();
+        }
+    } else {
+        std::stringstream ss(std::string(begin, end));
+        ss >> obj;
+        ss.get();
+        if (!ss.eof()) {
+            throw invalid_input();
+        }
     }
 }
 
+template<typename T>
+void read_from_string(std::string&& src, T& obj)
+{
+    static_assert(!std::is_same_v<T, std::string_view>,
+                  "string_view items can only be read from a string_source");
+    read_from_view(src, obj);
+}
+
 template<>
 void read_from_string(std::string&& src, std::string& obj);
 
+// Read the next non-whitespace character, whitespace delimited token, or
+// the longest prefix of a token that looks like a number from a source.
+char read_char(source& src);
+std::string read_token(source& src);
+std::string read_number(source& src, bool floating);
+
+// Values are read from sources like from streams: numbers as far as they look
+// like numbers, single characters, and anything else as a whitespace
+// delimited token.
 template<typename T>
+source& operator>>(source& src, T& value)
+{
+    if constexpr (std::is_integral_v<T> && sizeof(T) == 1 &&
+                  !std::is_same_v<T, bool>) {
+        value = static_cast<T>(read_char(src));
+    } else if constexpr (std::is_arithmetic_v<T>) {
+        read_from_string(read_number(src, std::is_floating_point_v<T>), value);
+    } else {
+        read_from_string(read_token(src), value);
+    }
+    return src;
+}
+
+template<typename T, typename Executor = nstr_private::nfa_executor>
 class pattn_t
 {
-    template<typename S>
-    friend std::istream& operator>>(std::istream&, pattn_t<S>);
-    nstr_private::nfa_executor nfa;
+    template<typename S, typename E>
+    friend std::istream& operator>>(std::istream&, pattn_t<S, E>);
+    template<typename S, typename E>
+    friend source& operator>>(source&, pattn_t<S, E>);
+    template<typename M>
+    friend bool resume(push_source&, M&);
+    Executor nfa;
     T& dst;
+    nstr_private::pattn_progress progress;
+
+    template<typename Reader>
+    void read(Reader& reader);
+    bool resume_read(push_source& in);
+    void restart();
 
   public:
     pattn_t(const std::string& rx, T& dst);
+    template<typename Source>
+    pattn_t(static_regex<Source> rx, T& dst);
+    pattn_t(Executor&& nfa, T& dst);
 };
 
-template<typename T>
-pattn_t<T>::pattn_t(const std::string& rx, T& dst)
+template<typename T, typename Executor>
+pattn_t<T, Executor>::pattn_t(const std::string& rx, T& dst)
     : nfa(rx)
     , dst(dst)
 {}
 
-template<typename T>
-pattn_t<T> pattn(const std::string& rx, T& dst)
+template<typename T, typename Executor>
+template<typename Source>
+pattn_t<T, Executor>::pattn_t(static_regex<Source> rx, T& dst)
+    : nfa(rx)
+    , dst(dst)
+{}
+
+template<typename T, typename Executor>
+pattn_t<T, Executor>::pattn_t(Executor&& nfa, T& dst)
+    : nfa(std::move(nfa))
+    , dst(dst)
+{}
+
+template<typename T, typename Rx>
+pattn_t<T, nstr_private::executor_type_t<Rx>> pattn(const Rx& rx, T& dst)
 {
-    return pattn_t<T>(rx, dst);
+    return pattn_t<T, nstr_private::executor_type_t<Rx>>(rx, dst);
 }
 
-template<typename T>
-std::istream& operator>>(std::istream& is, pattn_t<T> what)
+template<typename T, typename Executor>
+template<typename Reader>
+void pattn_t<T, Executor>::read(Reader& reader)
 {
-    bool is_valid = what.nfa.match() == nstr_private::match_state::ACCEPT;
-    std::string buf, res;
-    while (true) {
-        uint8_t next = static_cast<uint8_t>(is.get());
-        if (is.eof()) {
-            is.clear();
-            break;
+    nstr_private::pattn_progress progress;
+    if (!nstr_private::read_pattern(reader, this->nfa, progress) ||
+        !progress.valid) {
+        throw invalid_input();
+    }
+    read_from_string(std::move(progress.bytes), this->dst);
+}
+
+template<typename T, typename Executor>
+bool pattn_t<T, Executor>::resume_read(push_source& in)
+{
+    if (!nstr_private::read_pattern(in, this->nfa, this->progress)) {
+        return false;
+    }
+    if (!this->progress.valid) {
+        throw invalid_input();
+    }
+    read_from_string(std::move(this->progress.bytes), this->dst);
+    return true;
+}
+
+template<typename T, typename Executor>
+void pattn_t<T, Executor>::restart()
+{
+    this->nfa.reset();
+    this->progress = {};
+}
+
+template<typename T, typename Executor>
+std::istream& operator>>(std::istream& is, pattn_t<T, Executor> what)
+{
+    nstr_private::stream_reader reader(is);
+    what.read(reader);
+    return is;
+}
+
+template<typename T, typename Executor>
+source& operator>>(source& src, pattn_t<T, Executor> what)
+{
+    what.read(src);
+    return src;
+}
+
+// Reads the longest prefix of the input that matches the regex, and converts
+// what each of its groups matched to the next target. The regex needs one
+// capturing group per target. The input is scanned once, the groups are then
+// found in the bytes matched.
+template<typename... Targets>
+class match_t
+{
+    template<typename... T>
+    friend std::istream& operator>>(std::istream&, match_t<T...>);
+    template<typename... T>
+    friend source& operator>>(source&, match_t<T...>);
+    template<typename M>
+    friend bool resume(push_source&, M&);
+    nstr_private::nfa_executor nfa;
+    std::tuple<Targets&...> dst;
+    nstr_private::pattn_progress progress;
+
+    template<typename Reader>
+    void read(Reader& reader);
+    bool resume_read(push_source& in);
+    void restart();
+    template<size_t... Indices>
+    void convert(const std::string& bytes, std::index_sequence<Indices...>);
+
+  public:
+    match_t(const std::string& rx, Targets&... dst);
+};
+
+template<typename... Targets>
+match_t<Targets...>::match_t(const std::string& rx, Targets&... dst)
+    : nfa(rx)
+    , dst(dst...)
+{
+    if (this->nfa.group_count() != sizeof...(Targets)) {
+        throw invalid_regex();
+    }
+}
+
+template<typename... Targets>
+match_t<Targets...> match(const std::string& rx, Targets&... dst)
+{
+    return match_t<Targets...>(rx, dst...);
+}
+
+template<typename... Targets>
+template<size_t... Indices>
+void match_t<Targets...>::convert(const std::string& bytes,
+                                  std::index_sequence<Indices...>)
+{
+    static_assert(
+        !(std::is_same_v<Targets, std::string_view> || ...),
+        "the bytes matched are gone once read, so they can't be viewed");
+    if (!this->nfa.find_groups(bytes)) {
+        throw invalid_input();
+    }
+    (read_from_view(this->nfa.group(Indices),
+                    std::get<Indices>(this->dst)),
+     ...);
+}
+
+template<typename... Targets>
+template<typename Reader>
+void match_t<Targets...>::read(Reader& reader)
+{
+    nstr_private::pattn_progress progress;
+    if (!nstr_private::read_pattern(reader, this->nfa, progress) ||
+        !progress.valid) {
+        throw invalid_input();
+    }
+    this->convert(progress.bytes, std::index_sequence_for<Targets...>());
+}
+
+template<typename... Targets>
+bool match_t<Targets...>::resume_read(push_source& in)
+{
+    if (!nstr_private::read_pattern(in, this->nfa, this->progress)) {
+        return false;
+    }
+    if (!this->progress.valid) {
+        throw invalid_input();
+    }
+    this->convert(this->progress.bytes,
+                  std::index_sequence_for<Targets...>());
+    return true;
+}
+
+template<typename... Targets>
+void match_t<Targets...>::restart()
+{
+    this->nfa.reset();
+    this->progress = {};
+}
+
+template<typename... Targets>
+std::istream& operator>>(std::istream& is, match_t<Targets...> what)
+{
+    nstr_private::stream_reader reader(is);
+    what.read(reader);
+    return is;
+}
+
+template<typename... Targets>
+source& operator>>(source& src, match_t<Targets...> what)
+{
+    what.read(src);
+    return src;
+}
+
+template<typename... Targets>
+class format_t;
+
+// A line format compiled once, to read any number of lines with. The spec is
+// a regex the line has to match up to its '\n', in which {int}, {float} and
+// {str} stand for groups matching an integer, a number and a token without
+// whitespace. Every capturing group is a field. The format keeps its automaton
+// and the last line it read, so reading a line doesn't allocate once the
+// buffers are big enough. A format reads one line at a time.
+class format
+{
+    template<typename... Targets>
+    friend class format_t;
+    nstr_private::nfa_executor nfa;
+    std::string line;
+    bool started;
+    bool ended;
+
+    template<typename Reader>
+    bool read_line(Reader& reader);
+    template<typename Reader>
+    void put_back(Reader& reader);
+    template<typename Reader>
+    [[noreturn]] void fail(Reader& reader);
+    template<typename T>
+    void read_field(size_t index, T& dst) const;
+    void restart();
+
+  public:
+    explicit format(const std::string& spec);
+
+    size_t field_count() const { return this->nfa.group_count(); }
+
+    // Reads the fields of the next line into dst, one target per field.
+    // string_view targets view the line, until the format reads the next one.
+    template<typename... Targets>
+    format_t<Targets...> operator()(Targets&... dst);
+};
+
+template<typename... Targets>
+class format_t
+{
+    template<typename... T>
+    friend std::istream& operator>>(std::istream&, format_t<T...>);
+    template<typename... T>
+    friend source& operator>>(source&, format_t<T...>);
+    template<typename M>
+    friend bool resume(push_source&, M&);
+    format& fmt;
+    std::tuple<Targets&...> dst;
+
+    template<typename Reader>
+    void read(Reader& reader);
+    bool resume_read(push_source& in);
+    void restart();
+    template<typename Reader, size_t... Indices>
+    void convert(Reader& reader, std::index_sequence<Indices...>);
+
+  public:
+    format_t(format& fmt, Targets&... dst);
+};
+
+// Feeds the line to the executor until the format accepts it, with the end of
+// the input standing in for a missing '\n'. Returns false if the input ran out
+// before that, but more may still come.
+template<typename Reader>
+bool format::read_line(Reader& reader)
+{
+    if (!this->started) {
+        this->started = true;
+        reader.set_mark();
+    }
+    uint8_t next;
+    while (reader.next(next)) {
+        this->line.push_back(next);
+        this->nfa.next(next);
+        if (this->nfa.match() != nstr_private::match_state::UNSURE) {
+            return true;
         }
-        buf.push_back(next);
-        what.nfa.next(next);
-        if (what.nfa.match() == nstr_private::match_state::ACCEPT) {
-            is_valid = true;
-            res.insert(res.end(), buf.begin(), buf.end());
-            buf.clear();
-        } else if (what.nfa.match() == nstr_private::match_state::REFUSE) {
-            break;
+    }
+    if (reader.suspended()) {
+        return false;
+    }
+    reader.set_eof();
+    this->ended = true;
+    if (!this->line.empty()) {
+        this->nfa.next('\n');
+        if (this->nfa.match() == nstr_private::match_state::ACCEPT) {
+            this->line.push_back('\n');
         }
     }
-    for (size_t i = buf.size(); i > 0; --i) {
-        is.putback(buf[i - 1]);
+    return true;
+}
+
+// Gives the line back to the input, without the '\n' added at its end.
+template<typename Reader>
+void format::put_back(Reader& reader)
+{
+    const bool added = this->ended && this->nfa.match() ==
+                                          nstr_private::match_state::ACCEPT;
+    reader.unread(this->line.size() - added);
+}
+
+// Puts the line back, and finds the field where the bytes read before the
+// refused one stopped matching.
+template<typename Reader>
+void format::fail(Reader& reader)
+{
+    this->put_back(reader);
+    if (!this->ended) {
+        this->line.pop_back();
+    }
+    throw invalid_field(this->nfa.groups_closed(this->line));
+}
+
+template<typename T>
+void format::read_field(size_t index, T& dst) const
+{
+    try {
+        read_from_view(this->nfa.group(index), dst);
+    } catch (const invalid_input&) {
+        throw invalid_field(index);
     }
-    if (!is_valid) {
+}
+
+template<typename... Targets>
+format_t<Targets...> format::operator()(Targets&... dst)
+{
+    return format_t<Targets...>(*this, dst...);
+}
+
+template<typename... Targets>
+format_t<Targets...>::format_t(format& fmt, Targets&... dst)
+    : fmt(fmt)
+    , dst(dst...)
+{
+    if (fmt.field_count() != sizeof...(Targets)) {
+        throw invalid_regex();
+    }
+}
+
+template<typename... Targets>
+template<typename Reader, size_t... Indices>
+void format_t<Targets...>::convert(Reader& reader,
+                                   std::index_sequence<Indices...>)
+{
+    if (this->fmt.nfa.match() != nstr_private::match_state::ACCEPT ||
+        !this->fmt.nfa.find_groups(this->fmt.line)) {
+        this->fmt.fail(reader);
+    }
+    try {
+        (this->fmt.read_field(Indices, std::get<Indices>(this->dst)), ...);
+    } catch (const invalid_input&) {
+        this->fmt.put_back(reader);
+        throw;
+    }
+    reader.drop_mark();
+}
+
+template<typename... Targets>
+template<typename Reader>
+void format_t<Targets...>::read(Reader& reader)
+{
+    this->fmt.restart();
+    if (!this->fmt.read_line(reader)) {
         throw invalid_input();
     }
-    read_from_string(std::move(res), what.dst);
+    this->convert(reader, std::index_sequence_for<Targets...>());
+}
+
+template<typename... Targets>
+bool format_t<Targets...>::resume_read(push_source& in)
+{
+    if (!this->fmt.read_line(in)) {
+        return false;
+    }
+    this->convert(in, std::index_sequence_for<Targets...>());
+    return true;
+}
+
+template<typename... Targets>
+void format_t<Targets...>::restart()
+{
+    this->fmt.restart();
+}
+
+template<typename... Targets>
+std::istream& operator>>(std::istream& is, format_t<Targets...> what)
+{
+    nstr_private::stream_reader reader(is);
+    what.read(reader);
     return is;
 }
 
+template<typename... Targets>
+source& operator>>(source& src, format_t<Targets...> what)
+{
+    what.read(src);
+    return src;
+}
+
+template<typename Executor = nstr_private::nfa_executor>
 class sep
 {
-    friend std::istream& operator>>(std::istream&, sep);
-    std::string dummy;
-    pattn_t<std::string> rx;
+    template<typename E>
+    friend std::istream& operator>>(std::istream&, sep<E>);
+    template<typename E>
+    friend source& operator>>(source&, sep<E>);
+    template<typename M>
+    friend bool resume(push_source&, M&);
+    Executor nfa;
+    nstr_private::pattn_progress progress;
+
+    template<typename Reader>
+    void read(Reader& reader);
+    bool resume_read(push_source& in);
+    void restart();
 
   public:
     sep(const std::string& regex);
-    sep(const sep&);
-    sep(const sep&&);
-    sep& operator=(const sep&);
-    sep& operator=(sep&&);
+    template<typename Source>
+    sep(static_regex<Source> regex);
 };
 
-std::istream& operator>>(std::istream& is, sep field);
+template<typename Source>
+sep(static_regex<Source>) -> sep<nstr_private::static_executor<Source>>;
+
+template<typename Executor>
+sep<Executor>::sep(const std::string& regex)
+    : nfa(regex)
+{}
+
+template<typename Executor>
+template<typename Source>
+sep<Executor>::sep(static_regex<Source> regex)
+    : nfa(regex)
+{}
+
+template<typename Executor>
+template<typename Reader>
+void sep<Executor>::read(Reader& reader)
+{
+    nstr_private::pattn_progress progress;
+    if (!nstr_private::read_pattern(reader, this->nfa, progress) ||
+        !progress.valid) {
+        throw invalid_input();
+    }
+}
+
+template<typename Executor>
+bool sep<Executor>::resume_read(push_source& in)
+{
+    if (!nstr_private::read_pattern(in, this->nfa, this->progress)) {
+        return false;
+    }
+    if (!this->progress.valid) {
+        throw invalid_input();
+    }
+    return true;
+}
+
+template<typename Executor>
+void sep<Executor>::restart()
+{
+    this->nfa.reset();
+    this->progress = {};
+}
+
+template<typename Executor>
+std::istream& operator>>(std::istream& is, sep<Executor> what)
+{
+    nstr_private::stream_reader reader(is);
+    what.read(reader);
+    return is;
+}
+
+template<typename Executor>
+source& operator>>(source& src, sep<Executor> what)
+{
+    what.read(src);
+    return src;
+}
 
 class all
 {
     friend std::istream& operator>>(std::istream&, all);
+    friend source& operator>>(source&, all);
     std::string& dst;
 
+    template<typename Reader>
+    void read(Reader& reader);
+
   public:
     all(std::string& dst);
 };
 
+template<typename Reader>
+void all::read(Reader& reader)
+{
+    uint8_t sym;
+    while (true) {
+        this->dst.append(reader.begin(), reader.end());
+        reader.consume(reader.end() - reader.begin());
+        if (!reader.next(sym)) {
+            break;
+        }
+        this->dst.push_back(sym);
+    }
+    reader.set_eof();
+}
+
 std::istream& operator>>(std::istream& is, all obj);
+source& operator>>(source& src, all obj);
+
+}
+
+namespace nstr_private {
+
+// Collects the bytes of a split item.
+template<typename Reader>
+class item_buffer
+{
+    std::string bytes;
+
+  public:
+    void clear(const Reader&) { this->bytes.clear(); }
+    void push_back(char c) { this->bytes.push_back(c); }
+    void append(const char* begin, const char* end)
+    {
+        this->bytes.append(begin, end);
+    }
+    size_t size() const { return this->bytes.size(); }
+    void resize(size_t size) { this->bytes.resize(size); }
+    template<typename T>
+    void convert(T& obj)
+    {
+        nstr::read_from_string(std::move(this->bytes), obj);
+    }
+};
 
+// Items read from memory are a range of the input, so they are never copied
+// and can be handed out as string_views.
+template<>
+class item_buffer<nstr::string_source>
+{
+    const char* first = nullptr;
+    size_t length = 0;
+
+  public:
+    void clear(const nstr::string_source& src)
+    {
+        this->first = src.begin();
+        this->length = 0;
+    }
+    void push_back(char) { ++this->length; }
+    void append(const char* begin, const char* end)
+    {
+        this->length += end - begin;
+    }
+    size_t size() const { return this->length; }
+    void resize(size_t size) { this->length = size; }
+    template<typename T>
+    void convert(T& obj)
+    {
+        nstr::read_from_view(std::string_view(this->first, this->length),
+                             obj);
+    }
+};
+
+template<typename ContT, typename = void>
+struct has_emplace_back : std::false_type
+{};
+
+template<typename ContT>
+struct has_emplace_back<
+    ContT,
+    std::void_t<decltype(std::declval<ContT&>().emplace_back(
+        std::declval<typename ContT::value_type>()))>> : std::true_type
+{};
+
+// Appends to sequences and inserts into anything else, without copying.
 template<typename ContT>
+void insert_item(ContT& dst, typename ContT::value_type&& item)
+{
+    if constexpr (has_emplace_back<ContT>::value) {
+        dst.emplace_back(std::move(item));
+    } else {
+        dst.insert(dst.end(), std::move(item));
+    }
+}
+
+enum class item_end
+{
+    SEPARATOR,
+    TERMINATOR,
+    SUSPENDED
+};
+
+// Finds the items of a split one at a time. An item can be read in several
+// steps if a push_source runs out of input in the middle of it.
+template<typename SepExecutor, typename FinExecutor>
+class splitter
+{
+    SepExecutor nfa_sep;
+    FinExecutor nfa_fin;
+    bool started;
+    bool sep_matched;
+    bool fin_matched;
+    size_t match_len;
+    size_t match_start;
+
+  public:
+    template<typename SepRx, typename FinRx>
+    splitter(const SepRx& seprx, const FinRx& finrx);
+
+    // Reads the next item into buf, returns false if it was the last one.
+    template<typename Reader, typename Buffer>
+    bool read_item(Reader& reader, Buffer& buf);
+    // Reads the next item into buf, or as much of it as there is input for.
+    template<typename Reader, typename Buffer>
+    item_end resume_item(Reader& reader, Buffer& buf);
+    // Forgets the item being read.
+    void restart();
+};
+
+template<typename SepExecutor, typename FinExecutor>
+template<typename SepRx, typename FinRx>
+splitter<SepExecutor, FinExecutor>::splitter(const SepRx& seprx,
+                                             const FinRx& finrx)
+    : nfa_sep(seprx)
+    , nfa_fin(finrx)
+    , started(false)
+    , sep_matched(false)
+    , fin_matched(false)
+    , match_len(0)
+    , match_start(0)
+{}
+}
+
+namespace nstr {
+
+template<typename ContT,
+         typename SepExecutor = nstr_private::nfa_executor,
+         typename FinExecutor = nstr_private::nfa_executor>
 class split_t
 {
-    template<typename T>
-    friend std::istream& operator>>(std::istream&, split_t<T>);
+    template<typename T, typename S, typename F>
+    friend std::istream& operator>>(std::istream&, split_t<T, S, F>);
+    template<typename Src, typename T, typename S, typename F>
+    friend std::enable_if_t<std::is_base_of_v<source, Src>, Src&> operator>>(
+        Src&,
+        split_t<T, S, F>);
+    template<typename M>
+    friend bool resume(push_source&, M&);
     ContT& dst;
-    nstr_private::nfa_executor nfa_sep;
-    nstr_private::nfa_executor nfa_fin;
+    nstr_private::splitter<SepExecutor, FinExecutor> items;
+    nstr_private::item_buffer<push_source> pending;
+
+    template<typename Reader>
+    void read(Reader& reader);
+    bool resume_read(push_source& in);
+    void restart();
 
   public:
-    split_t(const std::string& seprx, const std::string& finrx, ContT& dst);
+    template<typename SepRx, typename FinRx>
+    split_t(const SepRx& seprx, const FinRx& finrx, ContT& dst);
 };
 
-template<typename ContT>
-split_t<ContT>::split_t(const std::string& seprx,
-                        const std::string& finrx,
-                        ContT& dst)
+template<typename ContT, typename SepExecutor, typename FinExecutor>
+template<typename SepRx, typename FinRx>
+split_t<ContT, SepExecutor, FinExecutor>::split_t(const SepRx& seprx,
+                                                  const FinRx& finrx,
+                                                  ContT& dst)
     : dst(dst)
-    , nfa_sep(seprx)
-    , nfa_fin(finrx)
+    , items(seprx, finrx)
 {}
+}
 
-template<typename ContT>
-std::istream& operator>>(std::istream& is, split_t<ContT> obj)
+namespace nstr_private {
+
+template<typename SepExecutor, typename FinExecutor>
+template<typename Reader, typename Buffer>
+bool splitter<SepExecutor, FinExecutor>::read_item(Reader& reader, Buffer& buf)
 {
-    std::string buf;
-    bool sep_matched = false;
-    size_t match_len = 0, match_start = 0;
-    while (true) {
-        if (is.eof()) {
-            throw invalid_input();
+    const item_end end = this->resume_item(reader, buf);
+    if (end == item_end::SUSPENDED) {
+        this->restart();
+        throw nstr::invalid_input();
+    }
+    return end == item_end::SEPARATOR;
+}
+
+template<typename SepExecutor, typename FinExecutor>
+template<typename Reader, typename Buffer>
+item_end splitter<SepExecutor, FinExecutor>::resume_item(Reader& reader,
+                                                         Buffer& buf)
+{
+    if (!this->started) {
+        buf.clear(reader);
+        this->started = true;
+    }
+    uint8_t sym;
+    while (!this->fin_matched) {
+        if (!this->sep_matched && this->nfa_sep.idle() &&
+            this->nfa_fin.idle()) {
+            const size_t skipped = skip_to_candidate(
+                reader, buf, this->nfa_sep.scanner(), this->nfa_fin.scanner());
+            if (skipped > 0) {
+                this->nfa_sep.skip(skipped);
+                this->nfa_fin.skip(skipped);
+                continue;
+            }
+        }
+        if (!reader.next(sym)) {
+            if (reader.suspended()) {
+                return item_end::SUSPENDED;
+            }
+            reader.set_eof();
+            this->restart();
+            throw nstr::invalid_input();
         }
-        uint8_t sym = is.get();
-        obj.nfa_fin.next(sym);
-        obj.nfa_fin.start_path();
-        obj.nfa_sep.next(sym);
-        if (!sep_matched) {
-            obj.nfa_sep.start_path();
-        } else if (obj.nfa_sep.match() == nstr_private::match_state::ACCEPT) {
-            match_len = obj.nfa_sep.longest_match();
+        this->nfa_fin.next(sym);
+        this->nfa_fin.start_path();
+        this->nfa_sep.next(sym);
+        if (!this->sep_matched) {
+            this->nfa_sep.start_path();
+        } else if (this->nfa_sep.match() == match_state::ACCEPT) {
+            this->match_len = this->nfa_sep.longest_match();
         }
         buf.push_back(sym);
-        if (obj.nfa_fin.match() == nstr_private::match_state::ACCEPT) {
-            break;
+        if (this->nfa_fin.match() == match_state::ACCEPT) {
+            this->fin_matched = true;
+            this->match_len = this->nfa_fin.trim_short_matches();
+            this->match_start = buf.size() - this->match_len;
+            reader.set_mark();
+        } else if (!this->sep_matched &&
+                   this->nfa_sep.match() == match_state::ACCEPT) {
+            this->sep_matched = true;
+            this->match_len = this->nfa_sep.trim_short_matches();
+            this->match_start = buf.size() - this->match_len;
+            reader.set_mark();
+        } else if (this->sep_matched &&
+                   this->nfa_sep.match() == match_state::REFUSE) {
+            const size_t put_back =
+                buf.size() - this->match_start - this->match_len;
+            NSTR_COUNT(this->nfa_sep.count_put_back(put_back);)
+            reader.unread(put_back);
+            buf.resize(this->match_start);
+            this->restart();
+            return item_end::SEPARATOR;
         }
-        if (!sep_matched &&
-            obj.nfa_sep.match() == nstr_private::match_state::ACCEPT) {
-            sep_matched = true;
-            match_len = obj.nfa_sep.trim_short_matches();
-            match_start = buf.size() - match_len;
-        } else if (sep_matched &&
-                   obj.nfa_sep.match() == nstr_private::match_state::REFUSE) {
-            for (size_t i = buf.size(); i > match_start + match_len; --i) {
-                is.putback(buf.back());
-                buf.pop_back();
-            }
-            buf.resize(buf.size() - match_len);
-            typename ContT::value_type val;
-            read_from_string(std::move(buf), val);
-            std::fill_n(std::inserter(obj.dst, obj.dst.end()), 1, val);
-            obj.nfa_sep.reset();
-            obj.nfa_fin.reset();
-            sep_matched = false;
-            match_len = 0;
-            buf.clear();
-        }
-    }
-
-    match_len = obj.nfa_fin.trim_short_matches();
-    match_start = buf.size() - match_len;
-    while (obj.nfa_fin.match() != nstr_private::match_state::REFUSE) {
-        uint8_t sym = is.get();
-        obj.nfa_fin.next(sym);
+    }
+
+    while (this->nfa_fin.match() != match_state::REFUSE && reader.next(sym)) {
+        this->nfa_fin.next(sym);
         buf.push_back(sym);
-        if (obj.nfa_fin.match() == nstr_private::match_state::ACCEPT) {
-            match_len = obj.nfa_fin.longest_match();
+        if (this->nfa_fin.match() == match_state::ACCEPT) {
+            this->match_len = this->nfa_fin.longest_match();
         }
     }
-    for (size_t i = buf.size(); i > match_start + match_len; --i) {
-        is.putback(buf.back());
-        buf.pop_back();
+    if (this->nfa_fin.match() != match_state::REFUSE && reader.suspended()) {
+        return item_end::SUSPENDED;
+    }
+    const size_t put_back = buf.size() - this->match_start - this->match_len;
+    NSTR_COUNT(this->nfa_fin.count_put_back(put_back);)
+    reader.unread(put_back);
+    buf.resize(this->match_start);
+    this->restart();
+    return item_end::TERMINATOR;
+}
+
+template<typename SepExecutor, typename FinExecutor>
+void splitter<SepExecutor, FinExecutor>::restart()
+{
+    this->nfa_sep.reset();
+    this->nfa_fin.reset();
+    this->started = false;
+    this->sep_matched = false;
+    this->fin_matched = false;
+    this->match_len = 0;
+    this->match_start = 0;
+}
+}
+
+namespace nstr {
+
+template<typename ContT, typename SepExecutor, typename FinExecutor>
+template<typename Reader>
+void split_t<ContT, SepExecutor, FinExecutor>::read(Reader& reader)
+{
+    nstr_private::item_buffer<Reader> buf;
+    bool more = true;
+    while (more) {
+        more = this->items.read_item(reader, buf);
+        typename ContT::value_type val;
+        buf.convert(val);
+        nstr_private::insert_item(this->dst, std::move(val));
+    }
+}
+
+template<typename ContT, typename SepExecutor, typename FinExecutor>
+bool split_t<ContT, SepExecutor, FinExecutor>::resume_read(push_source& in)
+{
+    while (true) {
+        const nstr_private::item_end end =
+            this->items.resume_item(in, this->pending);
+        if (end == nstr_private::item_end::SUSPENDED) {
+            return false;
+        }
+        typename ContT::value_type val;
+        this->pending.convert(val);
+        nstr_private::insert_item(this->dst, std::move(val));
+        if (end == nstr_private::item_end::TERMINATOR) {
+            return true;
+        }
     }
-    buf.resize(buf.size() - match_len);
-    typename ContT::value_type val;
-    read_from_string(std::move(buf), val);
-    std::fill_n(std::inserter(obj.dst, obj.dst.end()), 1, val);
+}
+
+template<typename ContT, typename SepExecutor, typename FinExecutor>
+void split_t<ContT, SepExecutor, FinExecutor>::restart()
+{
+    this->items.restart();
+}
+
+template<typename ContT, typename SepExecutor, typename FinExecutor>
+std::istream& operator>>(std::istream& is,
+                         split_t<ContT, SepExecutor, FinExecutor> obj)
+{
+    nstr_private::stream_reader reader(is);
+    obj.read(reader);
     return is;
 }
 
-template<typename ContT>
-split_t<ContT> split(const std::string& seprx,
-                     const std::string& finrx,
-                     ContT& dst)
+template<typename Src,
+         typename ContT,
+         typename SepExecutor,
+         typename FinExecutor>
+std::enable_if_t<std::is_base_of_v<source, Src>, Src&> operator>>(
+    Src& src,
+    split_t<ContT, SepExecutor, FinExecutor> obj)
+{
+    obj.read(src);
+    return src;
+}
+
+template<typename SepRx, typename FinRx, typename ContT>
+split_t<ContT,
+        nstr_private::executor_type_t<SepRx>,
+        nstr_private::executor_type_t<FinRx>>
+split(const SepRx& seprx, const FinRx& finrx, ContT& dst)
+{
+    return split_t<ContT,
+                   nstr_private::executor_type_t<SepRx>,
+                   nstr_private::executor_type_t<FinRx>>(seprx, finrx, dst);
+}
+
+// Reads the items of a split one at a time while it's iterated, without
+// collecting them in a container. Whatever follows the last item read stays
+// in the input.
+template<typename T,
+         typename Reader,
+         typename SepExecutor,
+         typename FinExecutor>
+class split_range_t
+{
+    typedef std::conditional_t<std::is_base_of_v<source, Reader>,
+                               Reader&,
+                               Reader>
+        reader_type;
+
+    reader_type reader;
+    nstr_private::splitter<SepExecutor, FinExecutor> items;
+    nstr_private::item_buffer<Reader> buf;
+    T item;
+    bool started;
+    bool more;
+    bool finished;
+
+    void advance();
+
+  public:
+    class iterator
+    {
+        split_range_t* range;
+
+      public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+
+        iterator(split_range_t* range = nullptr);
+
+        const T& operator*() const { return this->range->item; }
+        const T* operator->() const { return &this->range->item; }
+        iterator& operator++();
+        void operator++(int) { ++*this; }
+        bool operator==(const iterator& other) const
+        {
+            return this->range == other.range;
+        }
+        bool operator!=(const iterator& other) const
+        {
+            return this->range != other.range;
+        }
+    };
+
+    template<typename Input, typename SepRx, typename FinRx>
+    split_range_t(Input& input, const SepRx& seprx, const FinRx& finrx);
+    split_range_t(const split_range_t&) = delete;
+    split_range_t& operator=(const split_range_t&) = delete;
+
+    iterator begin();
+    iterator end();
+};
+
+template<typename T,
+         typename Reader,
+         typename SepExecutor,
+         typename FinExecutor>
+template<typename Input, typename SepRx, typename FinRx>
+split_range_t<T, Reader, SepExecutor, FinExecutor>::split_range_t(
+    Input& input,
+    const SepRx& seprx,
+    const FinRx& finrx)
+    : reader(input)
+    , items(seprx, finrx)
+    , item()
+    , started(false)
+    , more(true)
+    , finished(false)
+{}
+
+template<typename T,
+         typename Reader,
+         typename SepExecutor,
+         typename FinExecutor>
+void split_range_t<T, Reader, SepExecutor, FinExecutor>::advance()
+{
+    if (!this->more) {
+        this->finished = true;
+        return;
+    }
+    Reader& reader = this->reader;
+    this->more = this->items.read_item(reader, this->buf);
+    this->buf.convert(this->item);
+}
+
+template<typename T,
+         typename Reader,
+         typename SepExecutor,
+         typename FinExecutor>
+typename split_range_t<T, Reader, SepExecutor, FinExecutor>::iterator
+split_range_t<T, Reader, SepExecutor, FinExecutor>::begin()
+{
+    if (!this->started) {
+        this->started = true;
+        this->advance();
+    }
+    return iterator(this->finished ? nullptr : this);
+}
+
+template<typename T,
+         typename Reader,
+         typename SepExecutor,
+         typename FinExecutor>
+typename split_range_t<T, Reader, SepExecutor, FinExecutor>::iterator
+split_range_t<T, Reader, SepExecutor, FinExecutor>::end()
+{
+    return iterator();
+}
+
+template<typename T,
+         typename Reader,
+         typename SepExecutor,
+         typename FinExecutor>
+split_range_t<T, Reader, SepExecutor, FinExecutor>::iterator::iterator(
+    split_range_t* range)
+    : range(range)
+{}
+
+template<typename T,
+         typename Reader,
+         typename SepExecutor,
+         typename FinExecutor>
+typename split_range_t<T, Reader, SepExecutor, FinExecutor>::iterator&
+split_range_t<T, Reader, SepExecutor, FinExecutor>::iterator::operator++()
+{
+    this->range->advance();
+    if (this->range->finished) {
+        this->range = nullptr;
+    }
+    return *this;
+}
+
+template<typename T, typename SepRx, typename FinRx>
+split_range_t<T,
+              nstr_private::stream_reader,
+              nstr_private::executor_type_t<SepRx>,
+              nstr_private::executor_type_t<FinRx>>
+split_range(std::istream& is, const SepRx& seprx, const FinRx& finrx)
+{
+    return { is, seprx, finrx };
+}
+
+template<typename T, typename Src, typename SepRx, typename FinRx>
+std::enable_if_t<std::is_base_of_v<source, Src>,
+                 split_range_t<T,
+                               Src,
+                               nstr_private::executor_type_t<SepRx>,
+                               nstr_private::executor_type_t<FinRx>>>
+split_range(Src& src, const SepRx& seprx, const FinRx& finrx)
 {
-    return split_t<ContT>(seprx, finrx, dst);
+    return { src, seprx, finrx };
 }
 }
 #endif
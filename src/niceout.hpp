@@ -1,32 +1,80 @@
 #ifndef NICEOUT_HPP_INCLUDED
 #define NICEOUT_HPP_INCLUDED
 
+#include "sink.hpp"
 #include <iostream>
+#include <iterator>
+#include <locale>
 #include <string>
+#include <string_view>
+
+namespace nstr_private {
+
+// Tells if a stream formats values the same way a sink does.
+inline bool default_format(const std::ostream& os)
+{
+    const std::ios::fmtflags relevant =
+        std::ios::basefield | std::ios::floatfield | std::ios::adjustfield |
+        std::ios::boolalpha | std::ios::showbase | std::ios::showpoint |
+        std::ios::showpos | std::ios::uppercase;
+    return (os.flags() & relevant) == std::ios::dec && os.width() == 0 &&
+           os.getloc() == std::locale::classic();
+}
+}
 
 namespace nstr {
 
+// The separator is only viewed, it must outlive the join_t.
 template<typename ItorT>
 class join_t
 {
-    std::string sep;
+    std::string_view sep;
     ItorT begin, end;
 
     template<typename T>
     friend std::ostream& operator<<(std::ostream& os, join_t<T> obj);
+    template<typename T>
+    friend sink& operator<<(sink& out, join_t<T> obj);
+
+    void write(sink& out, int precision)
+    {
+        if (this->begin != this->end) {
+            nstr_private::format_value(out, *this->begin, precision);
+            while (++this->begin != this->end) {
+                out.append(this->sep);
+                nstr_private::format_value(out, *this->begin, precision);
+            }
+        }
+    }
 
   public:
-    join_t(std::string&& sep, ItorT begin, ItorT end)
-        : sep(std::move(sep))
+    typedef typename std::iterator_traits<ItorT>::value_type value_type;
+
+    join_t(std::string_view sep, ItorT begin, ItorT end)
+        : sep(sep)
         , begin(begin)
         , end(end)
     {}
 };
 
+// Numbers, characters and strings are formatted into a buffer and written to
+// the stream buffer in big blocks, unless the stream was told to format them
+// differently.
 template<typename T>
 std::ostream&
 operator<<(std::ostream& os, join_t<T> obj)
 {
+    typedef typename join_t<T>::value_type value_type;
+    if constexpr (nstr_private::formats_v<value_type>) {
+        if (nstr_private::default_format(os)) {
+            const std::ostream::sentry ok(os);
+            if (ok) {
+                ostream_sink out(os);
+                obj.write(out, static_cast<int>(os.precision()));
+            }
+            return os;
+        }
+    }
     if (obj.begin != obj.end) {
         os << *obj.begin;
         while (++obj.begin != obj.end) {
@@ -36,19 +84,27 @@ operator<<(std::ostream& os, join_t<T> obj)
     return os;
 }
 
+template<typename T>
+sink& operator<<(sink& out, join_t<T> obj)
+{
+    static_assert(nstr_private::formats_v<typename join_t<T>::value_type>,
+                  "sinks only format numbers, characters and strings");
+    obj.write(out, 6);
+    return out;
+}
+
 template<typename ItorT>
 join_t<ItorT>
-join(std::string&& sep, ItorT begin, ItorT end)
+join(std::string_view sep, ItorT begin, ItorT end)
 {
-    return join_t<ItorT>(std::move(sep), std::move(begin), std::move(end));
+    return join_t<ItorT>(sep, std::move(begin), std::move(end));
 }
 
 template<typename ContT>
 join_t<typename ContT::const_iterator>
-join(std::string&& sep, const ContT& obj)
+join(std::string_view sep, const ContT& obj)
 {
-    return join_t<typename ContT::const_iterator>(
-        std::move(sep), obj.begin(), obj.end());
+    return join_t<typename ContT::const_iterator>(sep, obj.begin(), obj.end());
 }
 }
 
@@ -1,7 +1,10 @@
 #ifndef NICESTREAM_HPP_INCLUDED
 #define NICESTREAM_HPP_INCLUDED
 
+#include "mapped_file.hpp"
 #include "nicein.hpp"
 #include "niceout.hpp"
+#include "parallel.hpp"
+#include "records.hpp"
 
 #endif
@@ -0,0 +1,320 @@
+#ifndef PARALLEL_HPP_INCLUDED
+#define PARALLEL_HPP_INCLUDED
+
+#include "nicein.hpp"
+#include "niceout.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace nstr_private {
+
+// Chunks smaller than this aren't worth a thread.
+const size_t min_chunk_size = 1 << 16;
+
+// The end of the first record ending at or after from, as until would find
+// it, or the end of the data if there's no record end.
+template<typename FinRx>
+size_t record_boundary(std::string_view data, size_t from, const FinRx& finrx)
+{
+    nstr::string_source src(data.substr(from));
+    try {
+        src >> nstr::until(finrx);
+    } catch (const nstr::invalid_input&) {
+        return data.size();
+    }
+    return src.begin() - data.data();
+}
+
+// Reads whole records starting at begin until reaching end, and returns
+// where the last record ended. That's past end if end isn't a record
+// boundary.
+template<typename ContT, typename SepExecutor, typename FinExecutor>
+size_t split_records(std::string_view data,
+                     size_t begin,
+                     size_t end,
+                     splitter<SepExecutor, FinExecutor>& items,
+                     ContT& dst)
+{
+    nstr::string_source src(data.substr(begin));
+    item_buffer<nstr::string_source> buf;
+    while (size_t(src.begin() - data.data()) < end) {
+        bool more = true;
+        while (more) {
+            more = items.read_item(src, buf);
+            typename ContT::value_type val;
+            buf.convert(val);
+            insert_item(dst, std::move(val));
+        }
+    }
+    return src.begin() - data.data();
+}
+
+// Slices with fewer items than this aren't worth a thread.
+const size_t min_slice_size = 1 << 14;
+
+// Collects what's written to it in a string.
+class string_sink : public nstr::sink
+{
+    std::string& dst;
+
+  protected:
+    void write(const char* data, size_t count) override
+    {
+        this->dst.append(data, count);
+    }
+
+  public:
+    string_sink(std::string& dst)
+        : nstr::sink(1 << 14)
+        , dst(dst)
+    {}
+    ~string_sink() override { this->flush(); }
+};
+
+// The number of threads to use when asked for threads, one per core if 0.
+inline size_t thread_count(size_t threads)
+{
+    if (threads == 0) {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+    return threads;
+}
+
+// Runs work(i, worker) for every i below count on up to threads threads,
+// where worker numbers the thread below min(threads, count), and rethrows the
+// first exception in order of i.
+template<typename Work>
+void run_parallel(size_t count, size_t threads, const Work& work)
+{
+    std::vector<std::exception_ptr> errors(count);
+    std::atomic<size_t> next(0);
+    auto run = [&](size_t worker) {
+        for (size_t i = next++; i < count; i = next++) {
+            try {
+                work(i, worker);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < std::min(threads, count); ++i) {
+        workers.emplace_back(run, i);
+    }
+    run(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+}
+
+namespace nstr {
+
+template<typename ItorT>
+class parallel_join_t;
+
+template<typename ItorT>
+std::ostream& operator<<(std::ostream& os, parallel_join_t<ItorT> obj);
+template<typename ItorT>
+sink& operator<<(sink& out, parallel_join_t<ItorT> obj);
+
+// Formats the items of a random access range in slices on several threads,
+// and writes the slices in order. The output is the same as join's.
+template<typename ItorT>
+class parallel_join_t
+{
+    static_assert(
+        std::is_base_of_v<
+            std::random_access_iterator_tag,
+            typename std::iterator_traits<ItorT>::iterator_category>,
+        "parallel_join needs random access iterators");
+    static_assert(nstr_private::formats_v<
+                      typename std::iterator_traits<ItorT>::value_type>,
+                  "parallel_join only formats numbers, characters and strings");
+
+    friend std::ostream& operator<<<>(std::ostream&, parallel_join_t);
+    friend sink& operator<<<>(sink&, parallel_join_t);
+    std::string_view sep;
+    ItorT begin, end;
+    size_t threads;
+
+    size_t thread_count() const;
+    std::vector<std::string> format(int precision) const;
+
+  public:
+    parallel_join_t(std::string_view sep,
+                    ItorT begin,
+                    ItorT end,
+                    size_t threads)
+        : sep(sep)
+        , begin(begin)
+        , end(end)
+        , threads(threads)
+    {}
+};
+
+template<typename ItorT>
+size_t parallel_join_t<ItorT>::thread_count() const
+{
+    return nstr_private::thread_count(this->threads);
+}
+
+template<typename ItorT>
+std::vector<std::string> parallel_join_t<ItorT>::format(int precision) const
+{
+    const size_t size = this->end - this->begin;
+    const size_t threads = this->thread_count();
+    const size_t slices = std::max<size_t>(
+        1, std::min(4 * threads, size / nstr_private::min_slice_size));
+    std::vector<std::string> results(slices);
+    nstr_private::run_parallel(slices, threads, [&](size_t i, size_t) {
+        nstr_private::string_sink out(results[i]);
+        const ItorT first = this->begin + i * size / slices;
+        const ItorT last = this->begin + (i + 1) * size / slices;
+        for (ItorT it = first; it != last; ++it) {
+            if (it != first || i > 0) {
+                out.append(this->sep);
+            }
+            nstr_private::format_value(out, *it, precision);
+        }
+    });
+    return results;
+}
+
+// Streams with formatting settings a sink can't follow get a plain join, and
+// so does everything if there's only one thread.
+template<typename ItorT>
+std::ostream& operator<<(std::ostream& os, parallel_join_t<ItorT> obj)
+{
+    if (obj.thread_count() == 1 || !nstr_private::default_format(os)) {
+        return os << join_t<ItorT>(obj.sep, obj.begin, obj.end);
+    }
+    const std::vector<std::string> slices =
+        obj.format(static_cast<int>(os.precision()));
+    const std::ostream::sentry ok(os);
+    if (ok) {
+        for (const std::string& slice : slices) {
+            if (os.rdbuf()->sputn(slice.data(), slice.size()) !=
+                std::streamsize(slice.size())) {
+                os.setstate(std::ios::badbit);
+                break;
+            }
+        }
+    }
+    return os;
+}
+
+template<typename ItorT>
+sink& operator<<(sink& out, parallel_join_t<ItorT> obj)
+{
+    if (obj.thread_count() == 1) {
+        return out << join_t<ItorT>(obj.sep, obj.begin, obj.end);
+    }
+    for (const std::string& slice : obj.format(6)) {
+        out.append(slice);
+    }
+    return out;
+}
+
+// Like join, but the items are formatted on threads threads, or one per core
+// if it's 0.
+template<typename ItorT>
+parallel_join_t<ItorT> parallel_join(std::string_view sep,
+                                     ItorT begin,
+                                     ItorT end,
+                                     size_t threads = 0)
+{
+    return { sep, begin, end, threads };
+}
+
+template<typename ContT>
+parallel_join_t<typename ContT::const_iterator>
+parallel_join(std::string_view sep, const ContT& obj, size_t threads = 0)
+{
+    return { sep, obj.begin(), obj.end(), threads };
+}
+
+// Does the same as reading split(seprx, finrx, dst) from data until it's
+// exhausted, on several threads. The data is cut into chunks where the
+// terminator matches, every chunk is split on its own, and the items are
+// added to dst in input order.
+template<typename SepRx, typename FinRx, typename ContT>
+void parallel_split(std::string_view data,
+                    const SepRx& seprx,
+                    const FinRx& finrx,
+                    ContT& dst,
+                    size_t threads = 0)
+{
+    typedef nstr_private::splitter<nstr_private::executor_type_t<SepRx>,
+                                   nstr_private::executor_type_t<FinRx>>
+        splitter_type;
+
+    threads = nstr_private::thread_count(threads);
+    const size_t chunk_count = std::max<size_t>(
+        1, std::min(4 * threads, data.size() / nstr_private::min_chunk_size));
+    std::vector<size_t> starts = { 0 };
+    for (size_t i = 1; i < chunk_count; ++i) {
+        const size_t from =
+            std::max(starts.back(), i * data.size() / chunk_count);
+        if (from < data.size()) {
+            starts.push_back(nstr_private::record_boundary(data, from, finrx));
+        }
+    }
+    starts.push_back(data.size());
+    starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+    const size_t chunks = starts.size() - 1;
+
+    // Errors are kept until it's known whether the chunk started at a record
+    // boundary.
+    const splitter_type prototype(seprx, finrx);
+    std::vector<splitter_type> splitters(std::min(threads, chunks), prototype);
+    std::vector<ContT> results(chunks);
+    std::vector<size_t> ends(chunks);
+    std::vector<std::exception_ptr> errors(chunks);
+    nstr_private::run_parallel(chunks, threads, [&](size_t i, size_t worker) {
+        splitter_type& items = splitters[worker];
+        try {
+            ends[i] = nstr_private::split_records(
+                data, starts[i], starts[i + 1], items, results[i]);
+        } catch (...) {
+            errors[i] = std::current_exception();
+            items = prototype;
+        }
+    });
+
+    // A chunk start is only a guess if the terminator can match inside a
+    // record. Chunks that didn't start where the previous one ended are
+    // split again from the right place.
+    size_t position = 0;
+    splitter_type items = prototype;
+    for (size_t i = 0; i < chunks && position < data.size(); ++i) {
+        if (starts[i] != position) {
+            results[i] = ContT();
+            position = nstr_private::split_records(
+                data, position, starts[i + 1], items, results[i]);
+        } else if (errors[i]) {
+            std::rethrow_exception(errors[i]);
+        } else {
+            position = ends[i];
+        }
+        for (auto& item : results[i]) {
+            nstr_private::insert_item(
+                dst, typename ContT::value_type(std::move(item)));
+        }
+    }
+}
+}
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef RECORDS_HPP_INCLUDED
+#define RECORDS_HPP_INCLUDED
+
+#include "nicein.hpp"
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace nstr {
+
+// Stands for a column of a record that isn't needed. Its field is found, but
+// not copied or converted.
+struct skip_col
+{};
+}
+
+namespace nstr_private {
+
+template<typename Column>
+using column_field_t =
+    std::conditional_t<std::is_same_v<Column, nstr::skip_col>,
+                       std::tuple<>,
+                       std::tuple<Column>>;
+
+// The tuple of the fields of the columns that aren't skipped.
+template<typename... Columns>
+using record_fields_t =
+    decltype(std::tuple_cat(std::declval<column_field_t<Columns>>()...));
+
+template<typename... Columns>
+struct column_reader;
+
+template<>
+struct column_reader<>
+{
+    template<size_t Field, typename Reader, typename Items, typename Fields>
+    static void read(Reader&, Items&, item_buffer<Reader>&, Fields&)
+    {}
+};
+
+// Reads the fields of a record column by column. Every field but the last
+// one must end with a separator, and the last one with the terminator.
+template<typename First, typename... Rest>
+struct column_reader<First, Rest...>
+{
+    template<size_t Field, typename Reader, typename Items, typename Fields>
+    static void read(Reader& reader,
+                     Items& items,
+                     item_buffer<Reader>& buf,
+                     Fields& fields)
+    {
+        const bool skipped = std::is_same_v<First, nstr::skip_col>;
+        bool more;
+        if constexpr (skipped) {
+            item_skipper skipper;
+            more = items.read_item(reader, skipper);
+        } else {
+            more = items.read_item(reader, buf);
+            buf.convert(std::get<Field>(fields));
+        }
+        if (more != (sizeof...(Rest) > 0)) {
+            throw nstr::invalid_input();
+        }
+        column_reader<Rest...>::template read<Field + !skipped>(
+            reader, items, buf, fields);
+    }
+};
+
+template<typename Row, typename Fields, size_t... I>
+void assign_record(Row& row, Fields&& fields, std::index_sequence<I...>)
+{
+    row = Row{ std::get<I>(std::move(fields))... };
+}
+}
+
+namespace nstr {
+
+template<typename Records, typename Row>
+class record_t;
+
+// Reads delimited records field by field, converting each field to the type
+// of its column. The separator and terminator are compiled once for all
+// records read with the same object.
+template<typename SepExecutor, typename FinExecutor, typename... Columns>
+class records_t
+{
+    template<typename R, typename Row>
+    friend class record_t;
+    nstr_private::splitter<SepExecutor, FinExecutor> items;
+
+    template<typename Reader, typename Row>
+    void read(Reader& reader, Row& row);
+
+  public:
+    typedef nstr_private::record_fields_t<Columns...> row_type;
+
+    template<typename SepRx, typename FinRx>
+    records_t(const SepRx& seprx, const FinRx& finrx);
+
+    // Reads the next record into row, which is either a row_type or a struct
+    // that can be initialized from the fields in order.
+    template<typename Row>
+    record_t<records_t, Row> operator()(Row& row);
+};
+
+template<typename SepExecutor, typename FinExecutor, typename... Columns>
+template<typename SepRx, typename FinRx>
+records_t<SepExecutor, FinExecutor, Columns...>::records_t(const SepRx& seprx,
+                                                           const FinRx& finrx)
+    : items(seprx, finrx)
+{
+    static_assert(sizeof...(Columns) > 0, "records need at least one column");
+}
+
+template<typename SepExecutor, typename FinExecutor, typename... Columns>
+template<typename Reader, typename Row>
+void records_t<SepExecutor, FinExecutor, Columns...>::read(Reader& reader,
+                                                           Row& row)
+{
+    nstr_private::item_buffer<Reader> buf;
+    if constexpr (std::is_same_v<Row, row_type>) {
+        nstr_private::column_reader<Columns...>::template read<0>(
+            reader, this->items, buf, row);
+    } else {
+        row_type fields;
+        nstr_private::column_reader<Columns...>::template read<0>(
+            reader, this->items, buf, fields);
+        nstr_private::assign_record(
+            row,
+            std::move(fields),
+            std::make_index_sequence<std::tuple_size_v<row_type>>());
+    }
+}
+
+template<typename SepExecutor, typename FinExecutor, typename... Columns>
+template<typename Row>
+record_t<records_t<SepExecutor, FinExecutor, Columns...>, Row>
+records_t<SepExecutor, FinExecutor, Columns...>::operator()(Row& row)
+{
+    return record_t<records_t, Row>(*this, row);
+}
+
+template<typename Records, typename Row>
+class record_t
+{
+    template<typename R, typename W>
+    friend std::istream& operator>>(std::istream&, record_t<R, W>);
+    template<typename Src, typename R, typename W>
+    friend std::enable_if_t<std::is_base_of_v<source, Src>, Src&> operator>>(
+        Src&,
+        record_t<R, W>);
+    Records& records;
+    Row& dst;
+
+    template<typename Reader>
+    void read(Reader& reader)
+    {
+        this->records.read(reader, this->dst);
+    }
+
+  public:
+    record_t(Records& records, Row& dst)
+        : records(records)
+        , dst(dst)
+    {}
+};
+
+template<typename Records, typename Row>
+std::istream& operator>>(std::istream& is, record_t<Records, Row> obj)
+{
+    nstr_private::stream_reader reader(is);
+    obj.read(reader);
+    return is;
+}
+
+template<typename Src, typename Records, typename Row>
+std::enable_if_t<std::is_base_of_v<source, Src>, Src&> operator>>(
+    Src& src,
+    record_t<Records, Row> obj)
+{
+    obj.read(src);
+    return src;
+}
+
+template<typename... Columns, typename SepRx, typename FinRx>
+records_t<nstr_private::executor_type_t<SepRx>,
+          nstr_private::executor_type_t<FinRx>,
+          Columns...>
+records(const SepRx& seprx, const FinRx& finrx)
+{
+    return { seprx, finrx };
+}
+}
+
+#endif
@@ -0,0 +1,203 @@
+#include "scan.hpp"
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NSTR_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace nstr_private {
+
+namespace {
+
+typedef const char* (*vector_find)(const char*,
+                                   const char*,
+                                   const uint8_t*,
+                                   bool);
+
+#ifdef NSTR_SCAN_X86
+__attribute__((target("sse2"))) const char* find_sse2(const char* begin,
+                                                      const char* end,
+                                                      const uint8_t* bytes,
+                                                      bool negated)
+{
+    const __m128i b0 = _mm_set1_epi8(static_cast<char>(bytes[0]));
+    const __m128i b1 = _mm_set1_epi8(static_cast<char>(bytes[1]));
+    const __m128i b2 = _mm_set1_epi8(static_cast<char>(bytes[2]));
+    const unsigned flip = negated ? 0xffff : 0;
+    for (; end - begin >= 16; begin += 16) {
+        const __m128i chunk =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        const __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, b0), _mm_cmpeq_epi8(chunk, b1)),
+            _mm_cmpeq_epi8(chunk, b2));
+        const unsigned mask = _mm_movemask_epi8(hits) ^ flip;
+        if (mask != 0) {
+            return begin + __builtin_ctz(mask);
+        }
+    }
+    return begin;
+}
+
+__attribute__((target("avx2"))) const char* find_avx2(const char* begin,
+                                                      const char* end,
+                                                      const uint8_t* bytes,
+                                                      bool negated)
+{
+    const __m256i b0 = _mm256_set1_epi8(static_cast<char>(bytes[0]));
+    const __m256i b1 = _mm256_set1_epi8(static_cast<char>(bytes[1]));
+    const __m256i b2 = _mm256_set1_epi8(static_cast<char>(bytes[2]));
+    const uint32_t flip = negated ? 0xffffffff : 0;
+    for (; end - begin >= 32; begin += 32) {
+        const __m256i chunk =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        const __m256i hits = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, b0),
+                            _mm256_cmpeq_epi8(chunk, b1)),
+            _mm256_cmpeq_epi8(chunk, b2));
+        const uint32_t mask =
+            static_cast<uint32_t>(_mm256_movemask_epi8(hits)) ^ flip;
+        if (mask != 0) {
+            return begin + __builtin_ctz(mask);
+        }
+    }
+    return begin;
+}
+#endif
+
+// Scans whole vectors only and returns where the scalar tail starts.
+const char* find_none(const char* begin, const char*, const uint8_t*, bool)
+{
+    return begin;
+}
+
+vector_find select_vector_find()
+{
+#ifdef NSTR_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return find_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return find_sse2;
+    }
+#endif
+    return find_none;
+}
+
+const vector_find find_vector = select_vector_find();
+
+// Stands in for the buffer of streams that failed, it never has input.
+input_window no_input;
+}
+
+const size_t byte_scanner::max_vector_bytes;
+
+byte_scanner::byte_scanner(const std::bitset<256>& members)
+    : members(members)
+    , bytes()
+    , byte_count(0)
+    , negated(members.count() > 128)
+{
+    for (size_t i = 0; i < 256; ++i) {
+        if (members[i] != this->negated) {
+            if (this->byte_count == max_vector_bytes) {
+                this->byte_count = max_vector_bytes + 1;
+                break;
+            }
+            this->bytes[this->byte_count++] = static_cast<uint8_t>(i);
+        }
+    }
+    for (size_t i = this->byte_count; i < max_vector_bytes; ++i) {
+        this->bytes[i] = this->bytes[0];
+    }
+}
+
+const char* byte_scanner::find(const char* begin, const char* end) const
+{
+    if (begin == end) {
+        return end;
+    }
+    if (this->byte_count == 0) {
+        return this->negated ? begin : end;
+    }
+    if (this->byte_count == 1 && !this->negated) {
+        const void* found = std::memchr(begin, this->bytes[0], end - begin);
+        return found ? static_cast<const char*>(found) : end;
+    }
+    if (this->byte_count <= max_vector_bytes) {
+        begin = find_vector(begin, end, this->bytes, this->negated);
+    }
+    for (; begin != end; ++begin) {
+        if (this->members[static_cast<uint8_t>(*begin)]) {
+            return begin;
+        }
+    }
+    return end;
+}
+
+stream_reader::stream_reader(std::istream& is)
+    : is(is)
+    , buf(&no_input)
+    , mark(nullptr)
+    , marked(false)
+{
+    const std::istream::sentry ok(is, true);
+    if (ok) {
+        this->buf = is.rdbuf();
+    }
+}
+
+bool stream_reader::refill(uint8_t& symbol)
+{
+    if (this->marked) {
+        this->spilled.append(this->mark, this->begin());
+    }
+    const int c = this->buf->sbumpc();
+    if (c != std::char_traits<char>::eof() && this->marked) {
+        this->spilled.push_back(static_cast<char>(c));
+    }
+    this->mark = this->begin();
+    if (c == std::char_traits<char>::eof()) {
+        return false;
+    }
+    symbol = static_cast<uint8_t>(c);
+    return true;
+}
+
+void stream_reader::set_mark()
+{
+    this->spilled.clear();
+    this->mark = this->begin();
+    this->marked = true;
+}
+
+void stream_reader::unread(size_t count)
+{
+    const size_t in_area = this->begin() - this->mark;
+    this->marked = false;
+    if (count <= in_area) {
+        input_window::unconsume(this->buf, count);
+        return;
+    }
+    input_window::unconsume(this->buf, in_area);
+    // Seekable buffers go back in one step, others only promise to take back
+    // a single byte, so stream_source is the way to read those.
+    const std::streamoff back = count - in_area;
+    if (this->buf->pubseekoff(-back, std::ios::cur, std::ios::in) !=
+        std::streampos(std::streamoff(-1))) {
+        this->spilled.clear();
+        this->mark = this->begin();
+        return;
+    }
+    for (size_t i = in_area; i < count; ++i) {
+        if (this->buf->sputbackc(this->spilled.back()) ==
+            std::char_traits<char>::eof()) {
+            this->is.setstate(std::ios::badbit);
+            break;
+        }
+        this->spilled.pop_back();
+    }
+    this->mark = this->begin();
+}
+}
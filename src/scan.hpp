@@ -0,0 +1,224 @@
+#ifndef SCAN_HPP_INCLUDED
+#define SCAN_HPP_INCLUDED
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <streambuf>
+#include <string>
+#include <type_traits>
+
+namespace nstr_private {
+
+// Finds the next byte of a fixed set in a buffer. Sets of up to three bytes
+// (or all but three bytes) are searched with SSE2 or AVX2 when the CPU
+// supports it, larger sets with a lookup table.
+class byte_scanner
+{
+    std::bitset<256> members;
+    uint8_t bytes[3];
+    size_t byte_count;
+    bool negated;
+
+  public:
+    static const size_t max_vector_bytes = 3;
+
+    byte_scanner(const std::bitset<256>& members = {});
+
+    // Scanning is pointless if every byte is a candidate.
+    bool trivial() const { return this->members.all(); }
+    const char* find(const char* begin, const char* end) const;
+};
+
+// Gives access to the get area of a stream buffer, so manipulators can scan
+// the buffered bytes in place.
+struct input_window : public std::streambuf
+{
+    static const char* begin(std::streambuf* buf)
+    {
+        return (buf->*&input_window::gptr)();
+    }
+    static const char* end(std::streambuf* buf)
+    {
+        return (buf->*&input_window::egptr)();
+    }
+    static void consume(std::streambuf* buf, size_t count)
+    {
+        (buf->*&input_window::gbump)(static_cast<int>(count));
+    }
+    static void unconsume(std::streambuf* buf, size_t count)
+    {
+        (buf->*&input_window::gbump)(-static_cast<int>(count));
+    }
+};
+
+// Reads bytes straight from the get area of a stream's buffer. The bytes read
+// since the last mark can be given back, by moving the get pointer while they
+// are still in the get area, and by seeking or with sputbackc once the buffer
+// was refilled.
+class stream_reader
+{
+    std::istream& is;
+    std::streambuf* buf;
+    std::string spilled;
+    const char* mark;
+    bool marked;
+
+    bool refill(uint8_t& symbol);
+
+  public:
+    stream_reader(std::istream& is);
+
+    bool next(uint8_t& symbol)
+    {
+        const char* pos = input_window::begin(this->buf);
+        if (pos == input_window::end(this->buf)) {
+            return this->refill(symbol);
+        }
+        symbol = static_cast<uint8_t>(*pos);
+        input_window::consume(this->buf, 1);
+        return true;
+    }
+    void set_mark();
+    // Gives back the last count bytes and drops the mark.
+    void unread(size_t count);
+    void drop_mark() { this->marked = false; }
+    void set_eof() { this->is.setstate(std::ios::eofbit); }
+    bool suspended() const { return false; }
+
+    // The bytes that can be read without refilling the buffer.
+    const char* begin() const { return input_window::begin(this->buf); }
+    const char* end() const { return input_window::end(this->buf); }
+    void consume(size_t count) { input_window::consume(this->buf, count); }
+};
+
+// Only measures what it's given, for input that is skipped.
+class item_skipper
+{
+    size_t length = 0;
+
+  public:
+    template<typename Reader>
+    void clear(const Reader&)
+    {
+        this->length = 0;
+    }
+    void push_back(char) { ++this->length; }
+    void append(const char* begin, const char* end)
+    {
+        this->length += end - begin;
+    }
+    size_t size() const { return this->length; }
+    void resize(size_t size) { this->length = size; }
+};
+
+// Moves the buffered bytes in front of the next byte either scanner finds
+// to dst, and returns how many bytes were moved.
+template<typename Reader, typename Dst>
+size_t skip_to_candidate(Reader& reader,
+                         Dst& dst,
+                         const byte_scanner& first,
+                         const byte_scanner& second)
+{
+    if (first.trivial() || second.trivial()) {
+        return 0;
+    }
+    const char* begin = reader.begin();
+    const char* found = second.find(begin, first.find(begin, reader.end()));
+    dst.append(begin, found);
+    reader.consume(found - begin);
+    return found - begin;
+}
+
+// Moves the next byte to dst if pred accepts it.
+template<typename Reader, typename Dst, typename Pred>
+bool take_one(Reader& reader, Dst& dst, Pred pred)
+{
+    uint8_t sym;
+    reader.set_mark();
+    if (!reader.next(sym)) {
+        reader.drop_mark();
+        reader.set_eof();
+        return false;
+    }
+    if (!pred(sym)) {
+        reader.unread(1);
+        return false;
+    }
+    reader.drop_mark();
+    dst.push_back(sym);
+    return true;
+}
+
+// Moves bytes to dst as long as pred accepts them, and returns how many were
+// moved. The buffered bytes are scanned in place.
+template<typename Reader, typename Dst, typename Pred>
+size_t take_while(Reader& reader, Dst& dst, Pred pred)
+{
+    size_t count = 0;
+    while (true) {
+        const char* begin = reader.begin();
+        const char* it = begin;
+        while (it != reader.end() && pred(static_cast<uint8_t>(*it))) {
+            ++it;
+        }
+        dst.append(begin, it);
+        reader.consume(it - begin);
+        count += it - begin;
+        if (it != reader.end() || !take_one(reader, dst, pred)) {
+            return count;
+        }
+        ++count;
+    }
+}
+
+inline bool is_space(uint8_t c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+inline bool is_digit(uint8_t c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Moves what reading a T from a stream takes from the input to dst: a single
+// character, the longest prefix of a token that looks like a number, or a
+// whitespace delimited token. Returns false if there's no such thing.
+template<typename T, typename Reader, typename Dst>
+bool scan_value(Reader& reader, Dst& dst, bool skip_ws)
+{
+    if (skip_ws) {
+        item_skipper space;
+        take_while(reader, space, is_space);
+    }
+    if constexpr (std::is_integral_v<T> && sizeof(T) == 1 &&
+                  !std::is_same_v<T, bool>) {
+        return take_one(reader, dst, [](uint8_t) { return true; });
+    } else if constexpr (std::is_arithmetic_v<T>) {
+        const auto sign = [](uint8_t c) { return c == '+' || c == '-'; };
+        const auto point = [](uint8_t c) { return c == '.'; };
+        const auto exponent = [](uint8_t c) { return c == 'e' || c == 'E'; };
+        const bool floating = std::is_floating_point_v<T>;
+        take_one(reader, dst, sign);
+        size_t digits = take_while(reader, dst, is_digit);
+        if (floating && take_one(reader, dst, point)) {
+            digits += take_while(reader, dst, is_digit);
+        }
+        if (digits == 0) {
+            return false;
+        }
+        if (floating && take_one(reader, dst, exponent)) {
+            take_one(reader, dst, sign);
+            take_while(reader, dst, is_digit);
+        }
+        return true;
+    } else {
+        const auto token = [](uint8_t c) { return !is_space(c); };
+        return take_while(reader, dst, token) > 0;
+    }
+}
+}
+
+#endif
@@ -0,0 +1,154 @@
+#include "sink.hpp"
+#include "nicein.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+namespace nstr_private {
+
+size_t format_floating(char* dst, double value, int precision)
+{
+#if defined(__cpp_lib_to_chars)
+    return std::to_chars(dst,
+                         dst + max_number_size + precision,
+                         value,
+                         std::chars_format::general,
+                         precision)
+               .ptr -
+           dst;
+#else
+    return std::snprintf(
+        dst, max_number_size + precision + 1, "%.*g", precision, value);
+#endif
+}
+
+size_t format_floating(char* dst, long double value, int precision)
+{
+#if defined(__cpp_lib_to_chars)
+    return std::to_chars(dst,
+                         dst + max_number_size + precision,
+                         value,
+                         std::chars_format::general,
+                         precision)
+               .ptr -
+           dst;
+#else
+    return std::snprintf(
+        dst, max_number_size + precision + 1, "%.*Lg", precision, value);
+#endif
+}
+}
+
+namespace nstr {
+
+const size_t sink::default_buffer_size;
+
+sink::sink(size_t buffer_size)
+    : storage(std::max<size_t>(buffer_size, 1))
+    , pos(storage.data())
+{}
+
+sink::~sink() {}
+
+// Writes out the buffered bytes, and grows the buffer if it can't hold count
+// bytes even when empty.
+char* sink::make_room(size_t count)
+{
+    this->flush();
+    if (this->storage.size() < count) {
+        this->storage.resize(count);
+        this->pos = this->storage.data();
+    }
+    return this->pos;
+}
+
+void sink::append(std::string_view data)
+{
+    if (data.size() > this->storage.size()) {
+        this->flush();
+        this->write(data.data(), data.size());
+        return;
+    }
+    std::memcpy(this->reserve(data.size()), data.data(), data.size());
+    this->pos += data.size();
+}
+
+void sink::flush()
+{
+    const size_t count = this->pos - this->storage.data();
+    this->pos = this->storage.data();
+    if (count > 0) {
+        this->write(this->storage.data(), count);
+    }
+}
+
+ostream_sink::ostream_sink(std::ostream& os, size_t buffer_size)
+    : sink(buffer_size)
+    , os(os)
+{}
+
+ostream_sink::~ostream_sink()
+{
+    try {
+        this->flush();
+    } catch (...) {
+    }
+}
+
+void ostream_sink::write(const char* data, size_t count)
+{
+    std::streambuf* buf = this->os.rdbuf();
+    if (buf == nullptr ||
+        buf->sputn(data, count) != std::streamsize(count)) {
+        this->os.setstate(std::ios::badbit);
+    }
+}
+
+file_sink::file_sink(std::FILE* file, size_t buffer_size)
+    : sink(buffer_size)
+    , file(file)
+{}
+
+file_sink::~file_sink()
+{
+    try {
+        this->flush();
+    } catch (...) {
+    }
+}
+
+void file_sink::write(const char* data, size_t count)
+{
+    if (std::fwrite(data, 1, count, this->file) != count) {
+        throw stream_error();
+    }
+}
+
+fd_sink::fd_sink(int fd, size_t buffer_size)
+    : sink(buffer_size)
+    , fd(fd)
+{}
+
+fd_sink::~fd_sink()
+{
+    try {
+        this->flush();
+    } catch (...) {
+    }
+}
+
+void fd_sink::write(const char* data, size_t count)
+{
+    while (count > 0) {
+        const ssize_t result = ::write(this->fd, data, count);
+        if (result < 0 && errno != EINTR) {
+            throw stream_error();
+        }
+        if (result > 0) {
+            data += result;
+            count -= result;
+        }
+    }
+}
+}
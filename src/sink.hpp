@@ -0,0 +1,163 @@
+#ifndef SINK_HPP_INCLUDED
+#define SINK_HPP_INCLUDED
+
+#include "convert.hpp"
+#include <charconv>
+#include <cstddef>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace nstr {
+
+// Output that skips the stream machinery. Formatted values are collected in a
+// buffer, which is written out in big blocks when it fills up, on flush() and
+// when the sink is destroyed.
+class sink
+{
+    std::vector<char> storage;
+    char* pos;
+
+  protected:
+    sink(size_t buffer_size);
+
+    // Writes all count bytes from data or throws stream_error.
+    virtual void write(const char* data, size_t count) = 0;
+
+  public:
+    static const size_t default_buffer_size = 1 << 16;
+
+    sink(const sink&) = delete;
+    sink& operator=(const sink&) = delete;
+    virtual ~sink();
+
+    // Returns where at least count bytes can be written. Bytes written there
+    // are only output after commit().
+    char* reserve(size_t count)
+    {
+        if (size_t(this->storage.data() + this->storage.size() - this->pos) <
+            count) {
+            return this->make_room(count);
+        }
+        return this->pos;
+    }
+    void commit(size_t count) { this->pos += count; }
+    void put(char c)
+    {
+        *this->reserve(1) = c;
+        ++this->pos;
+    }
+    void append(std::string_view data);
+    void flush();
+
+  private:
+    char* make_room(size_t count);
+};
+
+// Writes to an std::ostream's buffer. Sets badbit on the stream if not all
+// bytes were taken.
+class ostream_sink : public sink
+{
+    std::ostream& os;
+
+  protected:
+    void write(const char* data, size_t count) override;
+
+  public:
+    ostream_sink(std::ostream& os, size_t buffer_size = default_buffer_size);
+    ~ostream_sink() override;
+};
+
+// Writes to a C stdio stream. The sink doesn't close it.
+class file_sink : public sink
+{
+    std::FILE* file;
+
+  protected:
+    void write(const char* data, size_t count) override;
+
+  public:
+    file_sink(std::FILE* file, size_t buffer_size = default_buffer_size);
+    ~file_sink() override;
+};
+
+// Writes to a POSIX file descriptor. The sink doesn't close it.
+class fd_sink : public sink
+{
+    int fd;
+
+  protected:
+    void write(const char* data, size_t count) override;
+
+  public:
+    fd_sink(int fd, size_t buffer_size = default_buffer_size);
+    ~fd_sink() override;
+};
+}
+
+namespace nstr_private {
+
+// Types a sink formats itself, the same way a stream with default formatting
+// flags does.
+template<typename T>
+constexpr bool formats_v =
+    (std::is_arithmetic_v<T> &&
+     (!is_char_v<T> || std::is_same_v<T, char> ||
+      std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char>)) ||
+    std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view> ||
+    std::is_same_v<T, const char*> || std::is_same_v<T, char*>;
+
+// Enough for any integer, and for a float in %g format besides its digits.
+const size_t max_number_size = 48;
+
+// Formats value like printf's %.*g does, into at most
+// max_number_size + precision bytes.
+size_t format_floating(char* dst, double value, int precision);
+size_t format_floating(char* dst, long double value, int precision);
+
+template<typename T>
+void format_value(nstr::sink& out, const T& value, int precision)
+{
+    if constexpr (std::is_same_v<T, bool>) {
+        out.put(value ? '1' : '0');
+    } else if constexpr (is_char_v<T>) {
+        out.put(static_cast<char>(value));
+    } else if constexpr (std::is_integral_v<T>) {
+        char* dst = out.reserve(max_number_size);
+        out.commit(std::to_chars(dst, dst + max_number_size, value).ptr - dst);
+    } else if constexpr (std::is_floating_point_v<T>) {
+        typedef std::conditional_t<std::is_same_v<T, long double>,
+                                   long double,
+                                   double>
+            wide_type;
+        precision = precision < 0 ? 6 : precision;
+        out.commit(format_floating(out.reserve(max_number_size + precision),
+                                   wide_type(value),
+                                   precision));
+    } else {
+        out.append(value);
+    }
+}
+}
+
+namespace nstr {
+
+template<typename T>
+std::enable_if_t<nstr_private::formats_v<T>, sink&> operator<<(sink& out,
+                                                               const T& value)
+{
+    nstr_private::format_value(out, value, 6);
+    return out;
+}
+
+inline sink& operator<<(sink& out, std::string_view value)
+{
+    out.append(value);
+    return out;
+}
+}
+
+#endif
@@ -0,0 +1,185 @@
+#include "source.hpp"
+#include "nicein.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+namespace nstr {
+
+const size_t source::default_buffer_size;
+
+source::source(const char* begin, const char* end)
+    : pos(begin)
+    , last(end)
+    , mark(nullptr)
+    , exhausted(true)
+{}
+
+source::source(size_t buffer_size)
+    : storage(std::max<size_t>(buffer_size, 1))
+    , pos(storage.data())
+    , last(storage.data())
+    , mark(nullptr)
+    , exhausted(false)
+{}
+
+source::~source() {}
+
+size_t source::read(char*, size_t)
+{
+    return 0;
+}
+
+bool source::closed() const
+{
+    return true;
+}
+
+// Moves the bytes since the mark, or the unread ones if there's no mark, to
+// the front of the buffer, and makes room for at least room more bytes.
+// Returns where those go.
+char* source::compact(size_t room)
+{
+    const char* keep = this->mark != nullptr ? this->mark : this->pos;
+    const size_t kept = this->last - keep;
+    const size_t pos_offset = this->pos - keep;
+    char* base = this->storage.data();
+    std::memmove(base, keep, kept);
+    if (this->storage.size() - kept < room) {
+        this->storage.resize(std::max(2 * this->storage.size(), kept + room));
+        base = this->storage.data();
+    }
+    if (this->mark != nullptr) {
+        this->mark = base;
+    }
+    this->pos = base + pos_offset;
+    this->last = base + kept;
+    return base + kept;
+}
+
+bool source::refill()
+{
+    if (this->exhausted) {
+        return false;
+    }
+    char* dst = this->compact(1);
+    const size_t count = this->read(dst, this->storage.data() +
+                                             this->storage.size() - dst);
+    this->last += count;
+    this->exhausted = count == 0 && this->closed();
+    return count > 0;
+}
+
+void source::append(const char* data, size_t size)
+{
+    std::memcpy(this->compact(size), data, size);
+    this->last += size;
+}
+
+bool source::eof()
+{
+    return this->pos == this->last && !this->refill() && this->exhausted;
+}
+
+string_source::string_source(const char* begin, const char* end)
+    : source(begin, end)
+{}
+
+string_source::string_source(std::string_view data)
+    : source(data.data(), data.data() + data.size())
+{}
+
+std::string_view string_source::rest() const
+{
+    return std::string_view(this->begin(), this->end() - this->begin());
+}
+
+push_source::push_source(size_t buffer_size)
+    : source(buffer_size)
+    , input_closed(false)
+{}
+
+bool push_source::closed() const
+{
+    return this->input_closed;
+}
+
+void push_source::feed(const char* data, size_t size)
+{
+    if (this->input_closed) {
+        throw stream_error();
+    }
+    this->append(data, size);
+}
+
+void push_source::feed(std::string_view data)
+{
+    this->feed(data.data(), data.size());
+}
+
+void push_source::close()
+{
+    this->input_closed = true;
+}
+
+stream_source::stream_source(std::istream& is, size_t buffer_size)
+    : source(buffer_size)
+    , is(is)
+{}
+
+size_t stream_source::read(char* dst, size_t count)
+{
+    std::streambuf* buf = this->is.rdbuf();
+    if (buf == nullptr || !this->is.good()) {
+        return 0;
+    }
+    // Only wait for the first byte and take what's buffered besides it, so
+    // interactive input isn't held back until the whole buffer fills.
+    const int c = buf->sbumpc();
+    if (c == std::char_traits<char>::eof()) {
+        this->is.setstate(std::ios::eofbit);
+        return 0;
+    }
+    dst[0] = static_cast<char>(c);
+    const std::streamsize available = buf->in_avail();
+    if (available <= 0 || count == 1) {
+        return 1;
+    }
+    const std::streamsize more =
+        std::min<std::streamsize>(available, count - 1);
+    return 1 + buf->sgetn(dst + 1, more);
+}
+
+file_source::file_source(std::FILE* file, size_t buffer_size)
+    : source(buffer_size)
+    , file(file)
+{}
+
+size_t file_source::read(char* dst, size_t count)
+{
+    const size_t result = std::fread(dst, 1, count, this->file);
+    if (result == 0 && std::ferror(this->file)) {
+        throw stream_error();
+    }
+    return result;
+}
+
+fd_source::fd_source(int fd, size_t buffer_size)
+    : source(buffer_size)
+    , fd(fd)
+{}
+
+size_t fd_source::read(char* dst, size_t count)
+{
+    while (true) {
+        const ssize_t result = ::read(this->fd, dst, count);
+        if (result >= 0) {
+            return result;
+        }
+        if (errno != EINTR) {
+            throw stream_error();
+        }
+    }
+}
+}
@@ -0,0 +1,151 @@
+#ifndef SOURCE_HPP_INCLUDED
+#define SOURCE_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nstr {
+
+// Input that manipulators can read from without going through an
+// std::istream. The unread bytes sit in a buffer; sources backed by files
+// refill it, keeping everything since the mark so unread() only has to move
+// a pointer.
+class source
+{
+    std::vector<char> storage;
+    const char* pos;
+    const char* last;
+    const char* mark;
+    bool exhausted;
+
+    char* compact(size_t room);
+    bool refill();
+
+  protected:
+    source(const char* begin, const char* end);
+    source(size_t buffer_size);
+
+    // Reads at most count bytes into dst, returns 0 if there's nothing to
+    // read right now.
+    virtual size_t read(char* dst, size_t count);
+    // Tells if the input ended once read() returns 0.
+    virtual bool closed() const;
+    // Adds bytes to the buffer, keeping the unread ones.
+    void append(const char* data, size_t size);
+
+  public:
+    static const size_t default_buffer_size = 1 << 16;
+
+    source(const source&) = delete;
+    source& operator=(const source&) = delete;
+    virtual ~source();
+
+    bool next(uint8_t& symbol)
+    {
+        if (this->pos == this->last && !this->refill()) {
+            return false;
+        }
+        symbol = static_cast<uint8_t>(*this->pos++);
+        return true;
+    }
+    void set_mark() { this->mark = this->pos; }
+    // Lets the buffer drop the bytes since the mark once nothing is given back.
+    void drop_mark() { this->mark = nullptr; }
+    void unread(size_t count)
+    {
+        this->pos -= count;
+        this->mark = nullptr;
+    }
+    void set_eof() {}
+    bool eof();
+    // Tells if the buffer ran empty but more input may still come.
+    bool suspended() const
+    {
+        return this->pos == this->last && !this->exhausted;
+    }
+
+    // The bytes that can be read without refilling the buffer.
+    const char* begin() const { return this->pos; }
+    const char* end() const { return this->last; }
+    void consume(size_t count) { this->pos += count; }
+    // How many bytes the buffer has room for.
+    size_t buffer_size() const { return this->storage.size(); }
+};
+
+// Reads from bytes in memory, which must outlive the source.
+class string_source : public source
+{
+  public:
+    string_source(const char* begin, const char* end);
+    string_source(std::string_view data);
+
+    // The bytes that weren't read yet.
+    std::string_view rest() const;
+};
+
+// Reads bytes as they are fed to it, for input that arrives in chunks.
+// Manipulators read from it with nstr::resume, which stops when the fed bytes
+// run out and continues where it stopped once more are fed. Only the bytes a
+// manipulator may still give back are kept from earlier chunks.
+class push_source : public source
+{
+    bool input_closed;
+
+  protected:
+    bool closed() const override;
+
+  public:
+    push_source(size_t buffer_size = default_buffer_size);
+
+    void feed(const char* data, size_t size);
+    void feed(std::string_view data);
+    // Marks the end of the input, nothing can be fed after this.
+    void close();
+};
+
+// Reads from an std::istream through a buffer of its own, so manipulators can
+// look ahead and give back any number of bytes on streams that can't put back
+// more than one, like std::cin. Bytes the source read ahead aren't returned to
+// the stream, so once wrapped, the input should only be read from the source.
+class stream_source : public source
+{
+    std::istream& is;
+
+  protected:
+    size_t read(char* dst, size_t count) override;
+
+  public:
+    stream_source(std::istream& is, size_t buffer_size = default_buffer_size);
+};
+
+// Reads from a C stdio stream. The source doesn't close it.
+class file_source : public source
+{
+    std::FILE* file;
+
+  protected:
+    size_t read(char* dst, size_t count) override;
+
+  public:
+    file_source(std::FILE* file, size_t buffer_size = default_buffer_size);
+};
+
+// Reads from a POSIX file descriptor. The source doesn't close it.
+class fd_source : public source
+{
+    int fd;
+
+  protected:
+    size_t read(char* dst, size_t count) override;
+
+  public:
+    fd_source(int fd, size_t buffer_size = default_buffer_size);
+};
+}
+
+#endif
@@ -0,0 +1,672 @@
+#ifndef STATIC_NFA_HPP_INCLUDED
+#define STATIC_NFA_HPP_INCLUDED
+
+#include "nfa.hpp"
+#include "scan.hpp"
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Wraps a string literal into a compile-time regex, e.g. NSTR_RX(" *, *").
+#define NSTR_RX(pattern)                                                       \
+    ([] {                                                                      \
+        struct nstr_rx_source                                                  \
+        {                                                                      \
+            static constexpr const char* str() { return pattern; }             \
+        };                                                                     \
+        return ::nstr::static_regex<nstr_rx_source>();                         \
+    }())
+
+namespace nstr {
+
+template<typename Source>
+struct static_regex
+{
+    typedef Source source;
+};
+}
+
+// ***************************************************************
+// COMPILE-TIME NFA CONSTRUCTION & EXECUTION
+// ***************************************************************
+namespace nstr_private {
+
+// Not constexpr on purpose: reaching it while compiling a static regex turns
+// the malformed pattern into a compile error.
+[[noreturn]] void invalid_static_regex();
+
+const size_t ct_max_states = 64;
+const size_t ct_max_e_transitions = 16;
+
+struct ct_state
+{
+    uint64_t bytes[4];
+    int e_transitions[ct_max_e_transitions];
+    size_t e_count;
+    match_state match;
+
+    constexpr void add_byte(size_t c)
+    {
+        bytes[c / 64] |= uint64_t(1) << c % 64;
+    }
+
+    constexpr bool has_byte(size_t c) const
+    {
+        return (bytes[c / 64] >> c % 64) & 1;
+    }
+
+    constexpr void add_e_transition(int offset)
+    {
+        if (e_count == ct_max_e_transitions) {
+            invalid_static_regex();
+        }
+        e_transitions[e_count++] = offset;
+    }
+};
+
+// Mirrors nfa: the same construction steps, on fixed size arrays so that
+// it can run at compile time.
+struct ct_nfa
+{
+    ct_state states[ct_max_states];
+    size_t size;
+
+    constexpr void insert_front(const ct_state& state)
+    {
+        if (size == ct_max_states) {
+            invalid_static_regex();
+        }
+        for (size_t i = size; i > 0; --i) {
+            states[i] = states[i - 1];
+        }
+        states[0] = state;
+        ++size;
+    }
+
+    constexpr void append(const ct_nfa& other)
+    {
+        if (size + other.size > ct_max_states) {
+            invalid_static_regex();
+        }
+        for (size_t i = 0; i < other.size; ++i) {
+            states[size++] = other.states[i];
+        }
+    }
+
+    constexpr void append(const ct_state& state)
+    {
+        if (size == ct_max_states) {
+            invalid_static_regex();
+        }
+        states[size++] = state;
+    }
+};
+
+constexpr ct_state ct_make_state(match_state match)
+{
+    ct_state state{};
+    state.match = match;
+    return state;
+}
+
+constexpr ct_nfa ct_empty()
+{
+    ct_nfa result{};
+    result.append(ct_make_state(match_state::ACCEPT));
+    return result;
+}
+
+constexpr ct_nfa ct_atom(const ct_state& first)
+{
+    ct_nfa result{};
+    result.append(first);
+    result.append(ct_make_state(match_state::ACCEPT));
+    return result;
+}
+
+constexpr ct_nfa ct_concatenate(ct_nfa lhs, const ct_nfa& rhs)
+{
+    for (size_t i = 0; i < lhs.size; ++i) {
+        if (lhs.states[i].match == match_state::ACCEPT) {
+            lhs.states[i].add_e_transition(lhs.size - i);
+            lhs.states[i].match = match_state::UNSURE;
+        }
+    }
+    lhs.append(rhs);
+    return lhs;
+}
+
+constexpr ct_nfa ct_loop(ct_nfa x)
+{
+    x.append(ct_make_state(match_state::ACCEPT));
+    ct_state first = ct_make_state(match_state::UNSURE);
+    first.add_e_transition(1);
+    first.add_e_transition(x.size);
+    x.insert_front(first);
+    for (size_t i = 1; i < x.size - 1; ++i) {
+        if (x.states[i].match == match_state::ACCEPT) {
+            x.states[i].add_e_transition(-static_cast<int>(i) + 1);
+            x.states[i].add_e_transition(x.size - 1 - i);
+            x.states[i].match = match_state::UNSURE;
+        }
+    }
+    return x;
+}
+
+constexpr ct_nfa ct_unite(ct_nfa lhs, const ct_nfa& rhs)
+{
+    ct_state first = ct_make_state(match_state::UNSURE);
+    first.add_e_transition(1);
+    first.add_e_transition(lhs.size + 1);
+    lhs.insert_front(first);
+    lhs.append(rhs);
+    return lhs;
+}
+
+constexpr ct_nfa ct_repeat(const ct_nfa& x, int min, int max)
+{
+    ct_nfa result = ct_empty();
+    for (int i = 0; i < min; ++i) {
+        result = ct_concatenate(result, x);
+    }
+    if (max == -1) {
+        result = ct_concatenate(result, ct_loop(x));
+    } else {
+        if (max < min) {
+            invalid_static_regex();
+        }
+        for (int i = 0; i < max - min; ++i) {
+            for (size_t j = 0; j < result.size; ++j) {
+                if (result.states[j].match == match_state::ACCEPT) {
+                    result.states[j].add_e_transition(result.size - j);
+                }
+            }
+            result.append(x);
+        }
+    }
+    return result;
+}
+
+constexpr bool ct_isdigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+constexpr void ct_add_range(ct_state& state, uint8_t first, uint8_t last)
+{
+    for (size_t c = first; c <= last; ++c) {
+        state.add_byte(c);
+    }
+}
+
+constexpr void ct_negate(ct_state& state)
+{
+    for (size_t i = 0; i < 4; ++i) {
+        state.bytes[i] = ~state.bytes[i];
+    }
+}
+
+// Compile-time port of nfa::parse_regex. Groups don't capture here.
+constexpr ct_nfa ct_parse_regex(const char* regex,
+                                size_t size,
+                                size_t& offset,
+                                bool nested)
+{
+    ct_nfa result{}, last{}, alternatives{};
+    bool has_result = false, has_last = false, has_alternatives = false;
+    bool escape = false, closed = false;
+    for (; offset < size; ++offset) {
+        const char* base = regex + offset;
+        size_t rem = size - offset;
+        ct_nfa element{};
+        bool has_element = true;
+        if (base[0] == '\\' && !escape) {
+            escape = true;
+            continue;
+        } else if (base[0] == '(' && !escape) {
+            if (rem > 2 && base[1] == '?' && base[2] == ':') {
+                offset += 2;
+            }
+            ++offset;
+            element = ct_parse_regex(regex, size, offset, true);
+        } else if (base[0] == ')' && !escape) {
+            if (!nested) {
+                invalid_static_regex();
+            }
+            closed = true;
+            break;
+        } else if (base[0] == '|' && !escape) {
+            ct_nfa sequence = ct_empty();
+            if (has_last) {
+                sequence = has_result ? ct_concatenate(result, last) : last;
+            }
+            alternatives = has_alternatives
+                               ? ct_unite(alternatives, sequence)
+                               : sequence;
+            has_alternatives = true;
+            has_result = has_last = has_element = false;
+        } else if (base[0] == '{' && !escape) {
+            int min = 0, max = -1;
+            bool comma_ok = false, brace_ok = false;
+            for (size_t i = 1; i < rem; ++i, ++offset) {
+                if (base[i] == ',') {
+                    if (i == 1 || comma_ok) {
+                        invalid_static_regex();
+                    }
+                    comma_ok = true;
+                } else if (base[i] == '}') {
+                    if (i == 1) {
+                        invalid_static_regex();
+                    }
+                    brace_ok = true;
+                    ++offset;
+                    break;
+                } else if (ct_isdigit(base[i])) {
+                    if (comma_ok) {
+                        if (max == -1) {
+                            max = 0;
+                        }
+                        max = max * 10 + base[i] - '0';
+                    } else {
+                        min = min * 10 + base[i] - '0';
+                    }
+                } else {
+                    invalid_static_regex();
+                }
+            }
+            if (!brace_ok || !has_last) {
+                invalid_static_regex();
+            }
+            if (!comma_ok) {
+                max = min;
+            }
+            last = ct_repeat(last, min, max);
+            has_element = false;
+        } else if (base[0] == '*' && !escape) {
+            if (offset == 0 || !has_last) {
+                invalid_static_regex();
+            }
+            last = ct_loop(last);
+            has_element = false;
+        } else if (base[0] == '?' && !escape) {
+            if (offset == 0 || !has_last) {
+                invalid_static_regex();
+            }
+            last = ct_unite(last, ct_empty());
+            has_element = false;
+        } else if (base[0] == '+' && !escape) {
+            if (offset == 0 || !has_last) {
+                invalid_static_regex();
+            }
+            element = ct_loop(last);
+        } else if (base[0] == '[' && !escape) {
+            ct_state state = ct_make_state(match_state::UNSURE);
+            bool brack_esc = false;
+            uint8_t prev = 0;
+            bool has_prev = false;
+            bool is_range = false;
+            bool bracket_ok = false;
+            bool negate = false;
+            for (size_t i = 1; i < rem; ++i, ++offset) {
+                if (base[i] == '\\' && !brack_esc) {
+                    brack_esc = true;
+                    continue;
+                } else if (base[i] == '^' && !brack_esc) {
+                    if (i != 1) {
+                        invalid_static_regex();
+                    }
+                    negate = true;
+                } else if (base[i] == '-' && !brack_esc) {
+                    if (!has_prev) {
+                        invalid_static_regex();
+                    }
+                    is_range = true;
+                } else if (base[i] == ']' && !brack_esc) {
+                    ++offset;
+                    bracket_ok = true;
+                    break;
+                } else {
+                    if (is_range) {
+                        if (base[i] < prev) {
+                            invalid_static_regex();
+                        }
+                        ct_add_range(state, prev, base[i]);
+                        has_prev = false;
+                        is_range = false;
+                    } else {
+                        if (has_prev) {
+                            state.add_byte(prev);
+                        }
+                        prev = base[i];
+                        has_prev = true;
+                    }
+                }
+                brack_esc = false;
+            }
+            if (is_range || !bracket_ok) {
+                invalid_static_regex();
+            }
+            if (has_prev) {
+                state.add_byte(prev);
+            }
+            if (negate) {
+                ct_negate(state);
+            }
+            element = ct_atom(state);
+        } else if (base[0] == '.' && !escape) {
+            ct_state state = ct_make_state(match_state::UNSURE);
+            ct_add_range(state, 0, 255);
+            element = ct_atom(state);
+        } else if (escape) {
+            ct_state state = ct_make_state(match_state::UNSURE);
+            switch (base[0]) {
+                case 'd':
+                case 'D':
+                    ct_add_range(state, '0', '9');
+                    break;
+                case 'w':
+                case 'W':
+                    ct_add_range(state, 'a', 'z');
+                    ct_add_range(state, 'A', 'Z');
+                    ct_add_range(state, '_', '_');
+                    ct_add_range(state, '0', '9');
+                    break;
+                case 's':
+                case 'S':
+                    ct_add_range(state, ' ', ' ');
+                    ct_add_range(state, '\t', '\r');
+                    break;
+                default:
+                    state.add_byte(static_cast<uint8_t>(base[0]));
+            }
+            if (base[0] == 'D' || base[0] == 'W' || base[0] == 'S') {
+                ct_negate(state);
+            }
+            element = ct_atom(state);
+        } else {
+            ct_state state = ct_make_state(match_state::UNSURE);
+            state.add_byte(static_cast<uint8_t>(base[0]));
+            element = ct_atom(state);
+        }
+        if (has_element) {
+            if (has_last) {
+                result = has_result ? ct_concatenate(result, last) : last;
+                has_result = true;
+            }
+            last = element;
+            has_last = true;
+        }
+        escape = false;
+    }
+    if (nested != closed) {
+        invalid_static_regex();
+    }
+    ct_nfa sequence = ct_empty();
+    if (has_last) {
+        sequence = has_result ? ct_concatenate(result, last) : last;
+    }
+    return has_alternatives ? ct_unite(alternatives, sequence) : sequence;
+}
+
+constexpr ct_nfa ct_parse_regex(const char* regex)
+{
+    size_t size = 0;
+    while (regex[size] != '\0') {
+        ++size;
+    }
+    size_t offset = 0;
+    return ct_parse_regex(regex, size, offset, false);
+}
+
+// Bit-parallel form of a ct_nfa: bit i of a mask stands for state i. Every
+// byte transition of the construction leads to the next state, so a step is
+// just a union of precomputed closures.
+struct ct_tables
+{
+    uint64_t moves[256];
+    uint64_t advance[ct_max_states];
+    uint64_t start;
+    uint64_t accept;
+    // States that read a byte or accept, unlike those that only lead on.
+    uint64_t reads;
+};
+
+constexpr uint64_t ct_closure(const ct_nfa& nfa, size_t state)
+{
+    uint64_t seen = 0;
+    size_t stack[ct_max_states] = {};
+    size_t depth = 0;
+    stack[depth++] = state;
+    seen |= uint64_t(1) << state;
+    while (depth > 0) {
+        const size_t index = stack[--depth];
+        const ct_state& current = nfa.states[index];
+        for (size_t i = 0; i < current.e_count; ++i) {
+            const size_t target = index + current.e_transitions[i];
+            if (!((seen >> target) & 1)) {
+                seen |= uint64_t(1) << target;
+                stack[depth++] = target;
+            }
+        }
+    }
+    return seen;
+}
+
+constexpr ct_tables ct_compile(const ct_nfa& nfa)
+{
+    ct_tables tables{};
+    for (size_t i = 0; i < nfa.size; ++i) {
+        const ct_state& state = nfa.states[i];
+        for (size_t c = 0; c < 256; ++c) {
+            if (state.has_byte(c)) {
+                tables.moves[c] |= uint64_t(1) << i;
+            }
+        }
+        if (i + 1 < nfa.size) {
+            tables.advance[i] = ct_closure(nfa, i + 1);
+        }
+        if (state.match == match_state::ACCEPT) {
+            tables.accept |= uint64_t(1) << i;
+        }
+    }
+    for (size_t c = 0; c < 256; ++c) {
+        tables.reads |= tables.moves[c];
+    }
+    tables.reads |= tables.accept;
+    tables.start = ct_closure(nfa, 0);
+    return tables;
+}
+
+template<typename Source>
+struct static_program
+{
+    static constexpr ct_nfa automaton = ct_parse_regex(Source::str());
+    static constexpr size_t size = automaton.size;
+    static constexpr ct_tables tables = ct_compile(automaton);
+};
+
+// Same interface and semantics as nfa_executor, for a regex compiled into
+// the executable. Active states are kept in groups by start, earliest first,
+// as in the DFA of nfa_executor, and a group is dropped when earlier ones have
+// all its states. While all of them come from the same start_path() call, a
+// step is a handful of mask operations that the compiler unrolls.
+template<typename Source>
+class static_executor
+{
+    typedef static_program<Source> program;
+
+    uint64_t active;
+    size_t group_count;
+    uint64_t groups[program::size];
+    size_t starts[program::size];
+    size_t position;
+
+    static uint64_t step(uint64_t states, uint8_t symbol);
+
+  public:
+    static_executor(nstr::static_regex<Source> = {});
+
+    void reset();
+    void start_path();
+    void next(uint8_t symbol);
+    match_state match() const;
+    size_t longest_match() const;
+    size_t trim_short_matches();
+
+    bool idle() const;
+    void skip(size_t count);
+    static const byte_scanner& scanner();
+
+#ifdef NSTR_STATS
+    void count_put_back(size_t) {}
+#endif
+};
+
+template<typename Source>
+static_executor<Source>::static_executor(nstr::static_regex<Source>)
+    : active(0)
+    , group_count(0)
+    , groups()
+    , starts()
+    , position(0)
+{
+    this->start_path();
+}
+
+template<typename Source>
+uint64_t static_executor<Source>::step(uint64_t states, uint8_t symbol)
+{
+    const uint64_t moving = states & program::tables.moves[symbol];
+    uint64_t reached = 0;
+    for (size_t i = 0; i < program::size; ++i) {
+        reached |= program::tables.advance[i] & (0 - ((moving >> i) & 1));
+    }
+    return reached;
+}
+
+template<typename Source>
+void static_executor<Source>::reset()
+{
+    this->active = 0;
+    this->group_count = 0;
+    this->start_path();
+}
+
+template<typename Source>
+void static_executor<Source>::start_path()
+{
+    if ((program::tables.start & program::tables.reads & ~this->active) == 0) {
+        return;
+    }
+    this->groups[this->group_count] = program::tables.start;
+    this->starts[this->group_count] = this->position;
+    ++this->group_count;
+    this->active |= program::tables.start;
+}
+
+template<typename Source>
+void static_executor<Source>::next(uint8_t symbol)
+{
+    ++this->position;
+    if (this->group_count == 1) {
+        this->active = this->groups[0] = step(this->active, symbol);
+        this->group_count = this->active != 0;
+        return;
+    }
+    uint64_t covered = 0;
+    size_t kept = 0;
+    for (size_t i = 0; i < this->group_count; ++i) {
+        const uint64_t reached = step(this->groups[i], symbol);
+        if ((reached & program::tables.reads & ~covered) != 0) {
+            this->groups[kept] = reached;
+            this->starts[kept] = this->starts[i];
+            ++kept;
+            covered |= reached;
+        }
+    }
+    this->active = covered;
+    this->group_count = kept;
+}
+
+template<typename Source>
+match_state static_executor<Source>::match() const
+{
+    if (this->active == 0) {
+        return match_state::REFUSE;
+    }
+    return (this->active & program::tables.accept) ? match_state::ACCEPT
+                                                   : match_state::UNSURE;
+}
+
+template<typename Source>
+size_t static_executor<Source>::longest_match() const
+{
+    for (size_t i = 0; i < this->group_count; ++i) {
+        if (this->groups[i] & program::tables.accept) {
+            return this->position - this->starts[i];
+        }
+    }
+    return 0;
+}
+
+template<typename Source>
+size_t static_executor<Source>::trim_short_matches()
+{
+    for (size_t i = 0; i < this->group_count; ++i) {
+        if (this->groups[i] & program::tables.accept) {
+            this->groups[0] = this->groups[i];
+            this->starts[0] = this->starts[i];
+            this->active = this->groups[0];
+            this->group_count = 1;
+            return this->position - this->starts[0];
+        }
+    }
+    this->active = 0;
+    this->group_count = 0;
+    return 0;
+}
+
+template<typename Source>
+bool static_executor<Source>::idle() const
+{
+    return this->group_count == 1 && this->starts[0] == this->position;
+}
+
+template<typename Source>
+void static_executor<Source>::skip(size_t count)
+{
+    this->position += count;
+    this->starts[0] = this->position;
+}
+
+template<typename Source>
+const byte_scanner& static_executor<Source>::scanner()
+{
+    static const byte_scanner result = [] {
+        std::bitset<256> first;
+        for (size_t c = 0; c < 256; ++c) {
+            first[c] = (program::tables.moves[c] & program::tables.start) ||
+                       (program::tables.accept & program::tables.start);
+        }
+        return byte_scanner(first);
+    }();
+    return result;
+}
+
+template<typename Rx>
+struct executor_type
+{
+    typedef nfa_executor type;
+};
+
+template<typename Source>
+struct executor_type<nstr::static_regex<Source>>
+{
+    typedef static_executor<Source> type;
+};
+
+template<typename Rx>
+using executor_type_t = typename executor_type<Rx>::type;
+}
+#endif
@@ -1,8 +1,15 @@
+#include <bitset>
 #include <catch.hpp>
+#include <cstdio>
+#include <fstream>
+#include <functional>
 #include <list>
+#include <random>
 #include <set>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <tuple>
 
 #include <nfa.hpp>
 #include <nicestream.hpp>
@@ -11,6 +18,93 @@ using namespace nstr;
 using namespace nstr_private;
 typedef std::stringstream sstr;
 
+// Hands out its data in chunks of the given size, or byte by byte without a
+// get area if the size is 0, and takes back any byte it handed out.
+class chunked_buf : public std::streambuf
+{
+    std::string data;
+    size_t chunk;
+
+  protected:
+    size_t pos;
+
+  public:
+    chunked_buf(const std::string& data, size_t chunk)
+        : data(data)
+        , chunk(chunk)
+        , pos(0)
+    {}
+
+  protected:
+    int_type underflow() override
+    {
+        if (this->chunk > 0) {
+            this->pos += this->egptr() - this->eback();
+            const size_t size =
+                std::min(this->chunk, this->data.size() - this->pos);
+            char* begin = &this->data[0] + this->pos;
+            this->setg(begin, begin, begin + size);
+            if (size == 0) {
+                return traits_type::eof();
+            }
+            return traits_type::to_int_type(*begin);
+        }
+        if (this->pos == this->data.size()) {
+            return traits_type::eof();
+        }
+        return traits_type::to_int_type(this->data[this->pos]);
+    }
+    int_type uflow() override
+    {
+        if (this->chunk > 0) {
+            return std::streambuf::uflow();
+        }
+        const int_type c = this->underflow();
+        this->pos += c != traits_type::eof();
+        return c;
+    }
+    int_type pbackfail(int_type c) override
+    {
+        this->pos += this->gptr() - this->eback();
+        this->setg(nullptr, nullptr, nullptr);
+        if (this->pos == 0) {
+            return traits_type::eof();
+        }
+        --this->pos;
+        return c;
+    }
+};
+
+// Like chunked_buf, but takes back nothing once it handed out a new chunk.
+class one_way_buf : public chunked_buf
+{
+  public:
+    using chunked_buf::chunked_buf;
+
+  protected:
+    int_type pbackfail(int_type) override { return traits_type::eof(); }
+};
+
+// Takes back nothing, but can seek relative to the current position.
+class seek_only_buf : public one_way_buf
+{
+  public:
+    using one_way_buf::one_way_buf;
+
+  protected:
+    pos_type seekoff(off_type off,
+                     std::ios::seekdir dir,
+                     std::ios::openmode) override
+    {
+        if (dir != std::ios::cur) {
+            return pos_type(off_type(-1));
+        }
+        this->pos += this->gptr() - this->eback() + off;
+        this->setg(nullptr, nullptr, nullptr);
+        return pos_type(this->pos);
+    }
+};
+
 TEST_CASE("Regex parsing", "[regex]")
 {
     // simple literals
@@ -49,6 +143,17 @@ TEST_CASE("Regex parsing", "[regex]")
     CHECK_THROWS_AS(sep("x{1,7"), invalid_regex);
     CHECK_THROWS_AS(sep("x{1,"), invalid_regex);
     CHECK_THROWS_AS(sep("x{1"), invalid_regex);
+    CHECK_THROWS_AS(sep("{1}"), invalid_regex);
+
+    // groups and alternatives
+    CHECK_NOTHROW(sep("a|b|"));
+    CHECK_NOTHROW(sep("(a|bc)*d"));
+    CHECK_NOTHROW(sep("(?:ab)+()"));
+    CHECK_NOTHROW(sep("\\(a\\|b\\)"));
+    CHECK_THROWS_AS(sep("(ab"), invalid_regex);
+    CHECK_THROWS_AS(sep("ab)"), invalid_regex);
+    CHECK_THROWS_AS(sep("(*a)"), invalid_regex);
+    CHECK_THROWS_AS(sep("a|+"), invalid_regex);
 
     // character classes
     CHECK_NOTHROW(sep("[a-k7-9%=]"));
@@ -65,6 +170,78 @@ TEST_CASE("Regex parsing", "[regex]")
     CHECK_THROWS_AS(sep("[z-]"), invalid_regex);
 }
 
+TEST_CASE("Regex cache", "[regex]")
+{
+    {
+        clear_regex_cache();
+        const regex_cache_stats before = get_regex_cache_stats();
+        CHECK(before.size == 0);
+        CHECK_NOTHROW(sep("cache test [0-9]"));
+        CHECK_NOTHROW(sep("cache test [0-9]"));
+        CHECK_THROWS_AS(sep("cache test [9-0]"), invalid_regex);
+        const regex_cache_stats after = get_regex_cache_stats();
+        CHECK(after.hits == before.hits + 1);
+        CHECK(after.misses == before.misses + 2);
+        CHECK(after.size == 1);
+    }
+    {
+        clear_regex_cache();
+        set_regex_cache_capacity(2);
+        const regex_cache_stats before = get_regex_cache_stats();
+        CHECK_NOTHROW(sep("a"));
+        CHECK_NOTHROW(sep("b"));
+        CHECK_NOTHROW(sep("a"));
+        CHECK_NOTHROW(sep("c"));
+        CHECK_NOTHROW(sep("a"));
+        const regex_cache_stats after = get_regex_cache_stats();
+        CHECK(after.hits == before.hits + 2);
+        CHECK(after.evictions == before.evictions + 1);
+        CHECK(after.size == 2);
+        set_regex_cache_capacity(nfa_cache::default_capacity);
+    }
+}
+
+TEST_CASE("Regex statistics", "[regex]")
+{
+    clear_regex_cache();
+    clear_regex_stats();
+    {
+        std::string x;
+        sstr ss("s12345z");
+        ss >> pattn<std::string>("s[0-9]*z", x);
+        CHECK(x == "s12345z");
+    }
+    {
+        std::string x;
+        sstr ss("s12345z");
+        ss >> pattn<std::string>("s[0-9]*", x);
+        CHECK(x == "s12345");
+    }
+    const std::vector<regex_stats> stats = get_regex_stats();
+    if (!regex_stats_enabled) {
+        CHECK(stats.empty());
+        return;
+    }
+    REQUIRE(stats.size() == 2);
+    const regex_stats& s = stats[0];
+    CHECK(s.pattern == "s[0-9]*");
+    CHECK(s.states > 0);
+    CHECK(s.byte_classes == 3);
+    CHECK(s.compilations == 1);
+    CHECK(s.executors == 1);
+    CHECK(s.bytes_scanned == 7);
+    CHECK(s.bytes_put_back == 1);
+    CHECK(s.active_peak >= 1);
+    CHECK(s.average_active() > 0);
+    CHECK(s.closure_expansions > 0);
+
+    std::ostringstream dump;
+    dump_regex_stats(dump);
+    CHECK(dump.str().find("s[0-9]*: states=") == 0);
+    clear_regex_stats();
+    CHECK(get_regex_stats().empty());
+}
+
 TEST_CASE("nstr::sep", "[sep]")
 {
     {
@@ -107,6 +284,229 @@ TEST_CASE("nstr::pattn", "[pattn]")
     }
 }
 
+TEST_CASE("Groups and alternatives", "[pattn]")
+{
+    {
+        std::string x, str;
+        sstr ss("abcdabx;");
+        ss >> pattn("(ab|cd)+x", x) >> str;
+        CHECK(x == "abcdabx");
+        CHECK(str == ";");
+    }
+    {
+        std::string x, str;
+        sstr ss("catalog");
+        ss >> pattn("cat|catalog|dog", x) >> str;
+        CHECK(x == "catalog");
+        CHECK(str == "");
+    }
+    {
+        std::string x;
+        sstr ss("(a|b)");
+        ss >> pattn("\\((a\\|b)\\)", x);
+        CHECK(x == "(a|b)");
+    }
+    {
+        std::vector<std::string> vec, refvec = { "a", "b", "c" };
+        sstr ss("a, b;c.");
+        ss >> split("(, |;)", "\\.", vec);
+        CHECK(vec == refvec);
+    }
+}
+
+TEST_CASE("nstr::match", "[match]")
+{
+    {
+        std::string key, value, rest;
+        long ts;
+        sstr ss("key=value;ts=123;rest");
+        ss >> match("(\\w+)=(\\w*);ts=(\\d+)", key, value, ts) >> rest;
+        CHECK(key == "key");
+        CHECK(value == "value");
+        CHECK(ts == 123);
+        CHECK(rest == ";rest");
+    }
+    {
+        // the earliest alternative and the longest repetition win
+        std::string a, b;
+        sstr("abcd") >> match("(a|ab)(c|bcd)", a, b);
+        CHECK(a == "a");
+        CHECK(b == "bcd");
+        sstr("aaa") >> match("(a*)(a*)", a, b);
+        CHECK(a == "aaa");
+        CHECK(b == "");
+        sstr("xyxyz") >> match("(?:(x|y)+)(z?)", a, b);
+        CHECK(a == "y");
+        CHECK(b == "z");
+        sstr("ab") >> match("(x)?(ab|a)", a, b);
+        CHECK(a == "");
+        CHECK(b == "ab");
+    }
+    {
+        // groups around counted repetitions
+        std::string a, b;
+        const std::string text = std::string(600, 'x') + ",y";
+        sstr(text) >> match("([^,]{0,1000}),(y*)", a, b);
+        CHECK(a == std::string(600, 'x'));
+        CHECK(b == "y");
+        sstr(text) >> match("(x{300,})(x*),", a, b);
+        CHECK(a.size() == 600);
+        CHECK(b == "");
+        sstr(text) >> match("(x{300,400})(x*),", a, b);
+        CHECK(a.size() == 400);
+        CHECK(b.size() == 200);
+    }
+    {
+        // long matches that are neither one-pass nor short enough to
+        // backtrack
+        std::string a, b;
+        std::string text;
+        for (size_t i = 0; i < 20000; ++i) {
+            text += "ab";
+        }
+        sstr(text + "c") >> match("((?:ab|a)*)(b*)c", a, b);
+        CHECK(a == text);
+        CHECK(b == "");
+        sstr(text + "c") >> match("([ab]{300,})([ab]*)c", a, b);
+        CHECK(a == text);
+        CHECK(b == "");
+    }
+    {
+        int i;
+        std::string str;
+        CHECK_THROWS_AS(match("(\\d+)", i, str), invalid_regex);
+        CHECK_THROWS_AS(match("\\d+", i), invalid_regex);
+        sstr ss1("x12");
+        CHECK_THROWS_AS(ss1 >> match("(\\d+)", i), invalid_input);
+        sstr ss2("a=;");
+        CHECK_THROWS_AS(ss2 >> match("(\\w)=(\\d*)", str, i), invalid_input);
+    }
+    {
+        int a, b, c, d;
+        string_source src("10,20;30,40");
+        src >> match("(\\d+),(\\d+)", a, b) >> sep(";") >>
+            match("(\\d+),(\\d+)", c, d);
+        CHECK(a == 10);
+        CHECK(b == 20);
+        CHECK(c == 30);
+        CHECK(d == 40);
+    }
+    {
+        push_source in;
+        int i = 0;
+        std::string str;
+        auto record = match("(\\d+)=([a-z]+);", i, str);
+        in.feed("12=ab");
+        CHECK(!resume(in, record));
+        in.feed("c;x");
+        CHECK(resume(in, record));
+        CHECK(i == 12);
+        CHECK(str == "abc");
+    }
+}
+
+TEST_CASE("nstr::format", "[format]")
+{
+    {
+        format fmt("{int} *, *{int};{str}");
+        CHECK(fmt.field_count() == 3);
+        int i, j;
+        std::string str;
+        sstr ss("1, 2;abc\n-3 ,+4;x\n5,6;last");
+        ss >> fmt(i, j, str);
+        CHECK(i == 1);
+        CHECK(j == 2);
+        CHECK(str == "abc");
+        ss >> fmt(i, j, str);
+        CHECK(i == -3);
+        CHECK(j == 4);
+        CHECK(str == "x");
+        // the end of the input ends the last line
+        ss >> fmt(i, j, str);
+        CHECK(i == 5);
+        CHECK(j == 6);
+        CHECK(str == "last");
+        CHECK(ss.eof());
+    }
+    {
+        // groups are fields too, and views point into the line
+        format fmt("{float}=([a-z]*)(?:,x{2})?");
+        double d;
+        std::string_view view;
+        string_source src("1.5e3=abc,xx\n.5=\n");
+        src >> fmt(d, view);
+        CHECK(d == 1500);
+        CHECK(view == "abc");
+        src >> fmt(d, view);
+        CHECK(d == 0.5);
+        CHECK(view == "");
+        CHECK(src.eof());
+    }
+    {
+        format fmt("{int} *, *{int};{str}");
+        int i, j;
+        std::string str;
+        // fields that don't match, or don't convert, are reported and the
+        // line is left in the input
+        const std::pair<const char*, size_t> bad[] = {
+            { "x,2;a\n", 0 },  { "1,,2;a\n", 1 },
+            { "1,2a\n", 2 },   { "1,2;\n", 2 },
+            { "1,2;a b\n", 3 }, { "99999999999,2;a\n", 0 },
+            { "1,2;a b", 3 },
+        };
+        for (const auto& line : bad) {
+            sstr ss(line.first);
+            size_t field = 99;
+            try {
+                ss >> fmt(i, j, str);
+            } catch (const invalid_field& error) {
+                field = error.field;
+            }
+            CHECK(field == line.second);
+            std::string rest, expected = line.first;
+            std::getline(ss, rest);
+            if (expected.back() == '\n') {
+                expected.pop_back();
+            }
+            CHECK(rest == expected);
+        }
+        sstr empty("");
+        CHECK_THROWS_AS(empty >> fmt(i, j, str), invalid_input);
+        CHECK_THROWS_AS(fmt(i, j), invalid_regex);
+        CHECK_THROWS_AS(format("{int}{foo}"), invalid_regex);
+    }
+    {
+        // the same format reads many lines
+        format fmt("(\\w+)=\\{{int}\\}");
+        std::string text;
+        for (int i = 0; i < 1000; ++i) {
+            text += "k" + std::to_string(i) + "={" + std::to_string(i) + "}\n";
+        }
+        string_source src(text);
+        std::string key;
+        int value, sum = 0;
+        while (!src.eof()) {
+            src >> fmt(key, value);
+            sum += value;
+        }
+        CHECK(key == "k999");
+        CHECK(sum == 999 * 1000 / 2);
+    }
+    {
+        push_source in;
+        format fmt("{int}={str}");
+        int i = 0;
+        std::string str;
+        auto line = fmt(i, str);
+        in.feed("12=ab");
+        CHECK(!resume(in, line));
+        in.feed("c\nx");
+        CHECK(resume(in, line));
+        CHECK(i == 12);
+        CHECK(str == "abc");
+    }
+}
+
 TEST_CASE("nstr::skip", "[skip]")
 {
     {
@@ -134,6 +534,109 @@ TEST_CASE("nstr::skip", "[skip]")
         CHECK(i == 10);
         CHECK(s == "def");
     }
+    {
+        std::string s;
+        sstr ss("-1.5e3x 2147483647 +7 rest");
+        ss >> skip<double>() >> s >> skip<int, short>() >> s;
+        CHECK(s == "rest");
+    }
+    {
+        // Skipping fails exactly where reading does, and leaves the stream
+        // at the same place.
+        const auto same = [](auto value, const char* text, auto flags) {
+            std::istringstream skipped(text), read(text);
+            skipped.setf(flags);
+            read.setf(flags);
+            std::string rest_skipped, rest_read;
+            skipped >> skip<decltype(value)>();
+            read >> value;
+            CHECK(skipped.fail() == read.fail());
+            skipped.clear();
+            read.clear();
+            skipped >> rest_skipped;
+            read >> rest_read;
+            CHECK(rest_skipped == rest_read);
+        };
+        const auto none = std::ios::fmtflags();
+        for (const char* text : { "1e", "1e+", "1ex", "1e400", "1e-400",
+                                  "-1e-400", "0.0001e-320", "1000e-311",
+                                  ".5", "5.", ".", "inf", "+-1", "+" }) {
+            INFO(text);
+            same(0.0, text, none);
+            same(0.0f, text, none);
+        }
+        for (const char* text :
+             { "99999999999999999999", "2147483648", "-2147483649", "-1",
+               "-4294967296", "-0", "01", "2", "ff", "0x1f", "10 ff" }) {
+            INFO(text);
+            same(0, text, none);
+            same(0u, text, none);
+            same(short(0), text, none);
+            same(static_cast<unsigned short>(0), text, none);
+            same(false, text, none);
+            same(0, text, std::ios::hex);
+            same(0u, text, std::ios::oct);
+        }
+        for (const char* text : { "true", "false", "1", "0", "tru" }) {
+            INFO(text);
+            same(false, text, std::ios::boolalpha);
+            same(false, text, none);
+        }
+    }
+    {
+        int i = 0;
+        sstr ss("ff 10");
+        ss >> std::hex >> skip<int>() >> i;
+        CHECK(i == 16);
+        bool b = false;
+        sstr alpha("true false true");
+        alpha >> std::boolalpha >> skip<bool>() >> b;
+        CHECK(!alpha.fail());
+        sstr exponent("1e 2");
+        exponent >> skip<double>();
+        CHECK(exponent.fail());
+    }
+    for (size_t chunk : { 0, 1, 3 }) {
+        chunked_buf buf(" 1.25e-2,next", chunk);
+        std::istream is(&buf);
+        std::string s;
+        is >> skip<float>() >> s;
+        CHECK(s == ",next");
+    }
+    {
+        int i = 0;
+        sstr ss("abc 1");
+        ss >> skip<int>() >> i;
+        CHECK(ss.fail());
+        sstr end("1 ");
+        end >> skip<int, int>();
+        CHECK(end.fail());
+        CHECK(end.eof());
+        sstr noskip(" 1");
+        noskip >> std::noskipws >> skip<int>();
+        CHECK(noskip.fail());
+    }
+    {
+        std::string s;
+        string_source src("1.5 x 2 y;3 z\nrest");
+        src >> skip<double, std::tuple<>, int>() >> s;
+        CHECK(s == "y;3");
+        src >> skip_n<0>() >> skip_n<1>() >> s;
+        CHECK(s == "rest");
+        CHECK_THROWS_AS(src >> skip_n<1>(), invalid_input);
+    }
+    {
+        std::string s;
+        sstr("a b c d e") >> skip_n<3>() >> s;
+        CHECK(s == "d");
+        sstr("a,b,c,d\nx,y\nz\n") >> skip_n<3>(",") >> s;
+        CHECK(s == "d");
+        sstr ss("l1\nl2\n\n\nl3\n");
+        ss >> skip_n<2>(NSTR_RX("\n+")) >> s;
+        CHECK(s == "l3");
+        string_source src("a;b;c");
+        CHECK_THROWS_AS(src >> skip_n<3>(";"), invalid_input);
+    }
 }
 
 TEST_CASE("Match lengths", "[length]")
@@ -154,6 +657,901 @@ TEST_CASE("Match lengths", "[length]")
     }
 }
 
+TEST_CASE("DFA cache overflow", "[length]")
+{
+    {
+        // 2^13 DFA states, more than the cache can hold
+        nfa_executor e("[ab]*a[ab]{12}");
+        std::string input;
+        uint32_t seed = 12345;
+        for (size_t i = 0; i < 20000; ++i) {
+            seed = seed * 1103515245 + 12345;
+            input.push_back((seed >> 16) & 1 ? 'a' : 'b');
+            e.next(input.back());
+            const bool accept = i >= 12 && input[i - 12] == 'a';
+            CHECK((e.match() == match_state::ACCEPT) == accept);
+            CHECK(e.longest_match() == (accept ? i + 1 : 0));
+        }
+    }
+    {
+        // an executor taking over a cache that filled up slowly keeps the DFA
+        std::string input(10000, 'b');
+        uint32_t seed = 54321;
+        for (size_t i = 0; i < 1250; ++i) {
+            seed = seed * 1103515245 + 12345;
+            input.push_back((seed >> 16) & 1 ? 'a' : 'b');
+        }
+        {
+            nfa_executor first("[ab]*b[ab]{12}");
+            for (size_t i = 0; i < 10950; ++i) {
+                first.next(input[i]);
+            }
+            CHECK(first.uses_dfa());
+        }
+        nfa_executor second("[ab]*b[ab]{12}");
+        for (size_t i = 10950; i < input.size(); ++i) {
+            second.next(input[i]);
+        }
+        CHECK(second.uses_dfa());
+    }
+}
+
+TEST_CASE("Cursor deduplication", "[length]")
+{
+    {
+        nfa_executor e("[ab]*a[ab]{12}");
+        for (size_t i = 0; i < 20000; ++i) {
+            e.next(i % 3 == 0 ? 'a' : 'b');
+            e.start_path();
+        }
+        e.next('a');
+        for (size_t i = 0; i < 12; ++i) {
+            e.next('b');
+        }
+        CHECK(e.match() == match_state::ACCEPT);
+        CHECK(e.longest_match() == 20013);
+        CHECK(e.trim_short_matches() == 20013);
+        e.next('b');
+        CHECK(e.match() == match_state::UNSURE);
+        CHECK(e.longest_match() == 0);
+    }
+    {
+        std::string str;
+        sstr ss("xxxy");
+        ss >> sep("x?*") >> str;
+        CHECK(str == "y");
+    }
+}
+
+TEST_CASE("Shared states", "[length]")
+{
+    // a later start sharing states with an earlier one keeps them when the
+    // match is trimmed to it, and an unused counted repetition checks the
+    // same for the NFA
+    for (const std::string rx : { "a?b*c|b",
+                                  "b|a?b*c",
+                                  "(?:a?b*c|b)",
+                                  "a?b*c|b|z{300}",
+                                  "b|a?b*c|z{300}" }) {
+        {
+            std::string str, rest;
+            sstr ss("abbbcX");
+            ss >> until(rx, str) >> all(rest);
+            CHECK(str == "a");
+            CHECK(rest == "X");
+        }
+        {
+            std::vector<std::string> vec, refvec = { "xa", "y" };
+            sstr ss("xabbbcy;");
+            ss >> split(rx, ";", vec);
+            CHECK(vec == refvec);
+        }
+    }
+}
+
+TEST_CASE("Counted repetition", "[length]")
+{
+    CHECK(nfa_program("\\d{1,1000}").size() < 4);
+    CHECK(nfa_program("x[^,]{0,4096}y").size() < 8);
+    CHECK(nfa_program("\\d{1,1000}").has_counters());
+    CHECK(!nfa_program("\\d{1,256}").has_counters());
+
+    // Counted repetitions must match like the same repetition written out.
+    struct repetition
+    {
+        std::string prefix, atom;
+        int min, max;
+        std::string suffix;
+    };
+    const std::vector<repetition> repetitions = {
+        { "c", "[ab]", 2, 300, "c" }, { "", "[ab]", 0, 270, "b" },
+        { "", "a", 260, 300, "" },    { "c", "[ab]", 257, -1, "c" },
+        { "", ".", 0, 280, "c" },     { "a*", "b", 260, 261, "a" },
+        { "", "[^c]", 270, 270, "" }
+    };
+    auto read = [](const std::string& input, const std::string& rx) {
+        std::string result;
+        try {
+            std::string item, rest;
+            sstr ss(input);
+            ss >> until(rx, item) >> all(rest);
+            result += item + '|' + rest + '|';
+        } catch (const invalid_input&) {
+            result += "no match|";
+        }
+        try {
+            std::string item, rest;
+            sstr ss(input);
+            ss >> pattn(rx, item) >> all(rest);
+            result += item + '|' + rest + '|';
+        } catch (const invalid_input&) {
+            result += "no match|";
+        }
+        try {
+            std::vector<std::string> items;
+            sstr ss(input);
+            ss >> split(rx, "\n", items);
+            for (const auto& item : items) {
+                result += item + ',';
+            }
+        } catch (const invalid_input&) {
+            result += "no split";
+        }
+        return result;
+    };
+    std::mt19937 random(7);
+    for (const auto& rep : repetitions) {
+        std::string written = rep.prefix;
+        for (int i = 0; i < rep.min; ++i) {
+            written += rep.atom;
+        }
+        for (int i = rep.min; i < rep.max; ++i) {
+            written += rep.atom + '?';
+        }
+        if (rep.max < 0) {
+            written += rep.atom + '*';
+        }
+        const std::string counted =
+            rep.prefix + rep.atom + '{' + std::to_string(rep.min) + ',' +
+            (rep.max < 0 ? "" : std::to_string(rep.max)) + '}' + rep.suffix;
+        written += rep.suffix;
+        REQUIRE(nfa_program(counted).has_counters());
+        REQUIRE(!nfa_program(written).has_counters());
+        for (size_t i = 0; i < 50; ++i) {
+            std::string input;
+            const size_t size = random() % 700;
+            for (size_t j = 0; j < size; ++j) {
+                input += "aaabbbbc"[random() % (j % 300 < 280 ? 7 : 8)];
+            }
+            CHECK(read(input, counted) == read(input, written));
+        }
+    }
+    {
+        std::string field, rest;
+        sstr ss(std::string(3000, 'x') + ",rest");
+        ss >> pattn("[^,]{0,4096}", field) >> all(rest);
+        CHECK(field.size() == 3000);
+        CHECK(rest == ",rest");
+    }
+    {
+        // groups are copied for every repetition, so their bounds are limited
+        CHECK_THROWS_AS(sep("(?:ab){1,5000}"), invalid_regex);
+        CHECK_THROWS_AS(sep("(ab|c){300}"), invalid_regex);
+        CHECK_THROWS_AS(sep("(?:(?:ab){256}){256}"), invalid_regex);
+        CHECK(nfa_program("(?:ab|c){0,256}").size() < 2000);
+    }
+    {
+        std::string input = "zz", str, rest;
+        for (size_t i = 0; i < 80; ++i) {
+            input += "abc";
+        }
+        sstr ss(input + "ab;rest");
+        ss >> until("(?:ab|c){2,256};", str) >> all(rest);
+        CHECK(str == "zz");
+        CHECK(rest == "rest");
+    }
+    {
+        std::vector<std::string> vec, refvec = { "1", "2", "3" };
+        sstr ss("1abcab2" + std::string(256, 'c') + "3;");
+        ss >> split("(?:ab|c){1,256}", ";", vec);
+        CHECK(vec == refvec);
+    }
+    {
+        // copies carry on with the counts of the original
+        nfa_executor e("[ab]{400,500}c");
+        for (size_t i = 0; i < 450; ++i) {
+            e.next('a');
+        }
+        nfa_executor copy(e);
+        e.next('c');
+        copy.next('c');
+        CHECK(e.match() == match_state::ACCEPT);
+        CHECK(copy.match() == match_state::ACCEPT);
+        CHECK(copy.longest_match() == 451);
+    }
+}
+
+TEST_CASE("Byte classes", "[regex]")
+{
+    {
+        CHECK(nfa_program("[^x]").get_class_count() == 2);
+        CHECK(nfa_program("a*").get_class_count() == 2);
+        CHECK(nfa_program("\\d+,\\s").get_class_count() == 4);
+        nfa_program p("[a-c]x");
+        CHECK(p.byte_class('a') == p.byte_class('c'));
+        CHECK(p.byte_class('a') != p.byte_class('x'));
+        CHECK(p.byte_class('d') == p.byte_class('z'));
+    }
+    {
+        int a, b;
+        std::string c;
+        sstr ss("12, 34,\tabc");
+        ss >> a >> sep(",\\s") >> b >> sep(",\\s") >> c;
+        CHECK(a == 12);
+        CHECK(b == 34);
+        CHECK(c == "abc");
+    }
+}
+
+TEST_CASE("Byte scanner", "[scan]")
+{
+    {
+        std::string input;
+        uint32_t seed = 4321;
+        for (size_t i = 0; i < 1000; ++i) {
+            seed = seed * 1103515245 + 12345;
+            input.push_back(static_cast<char>(seed >> 16));
+        }
+        for (size_t size : { 0, 1, 2, 3, 4, 40, 252, 253, 255, 256 }) {
+            std::bitset<256> members;
+            for (size_t i = 0; i < size; ++i) {
+                members.set((i * 97) % 256);
+            }
+            byte_scanner scanner(members);
+            for (size_t from = 0; from < input.size(); from += 7) {
+                const char* begin = input.data() + from;
+                const char* end = input.data() + input.size();
+                const char* expected = begin;
+                while (expected != end &&
+                       !members[static_cast<uint8_t>(*expected)]) {
+                    ++expected;
+                }
+                CHECK(scanner.find(begin, end) == expected);
+            }
+        }
+    }
+    {
+        std::string line(100000, 'a'), str1, str2;
+        sstr ss(line + "\r\nbbb");
+        ss >> until("\r\n", str1) >> str2;
+        CHECK(str1 == line);
+        CHECK(str2 == "bbb");
+    }
+    {
+        std::string str1, str2;
+        sstr ss("aaa;;c;bd");
+        ss >> until(NSTR_RX(";b"), str1) >> str2;
+        CHECK(str1 == "aaa;;c");
+        CHECK(str2 == "d");
+    }
+    {
+        std::vector<std::string> vec, refvec;
+        std::string input;
+        for (size_t i = 0; i < 1000; ++i) {
+            refvec.push_back(std::string(i % 50, 'x') + std::to_string(i));
+            input += refvec.back() + (i + 1 < 1000 ? ", " : "\n");
+        }
+        sstr ss(input + "rest");
+        std::string rest;
+        ss >> split(", ", "\n", vec) >> rest;
+        CHECK(vec == refvec);
+        CHECK(rest == "rest");
+    }
+}
+
+TEST_CASE("Numeric conversion", "[convert]")
+{
+    {
+        int i;
+        read_from_string(" +42", i);
+        CHECK(i == 42);
+        read_from_string("-2147483648", i);
+        CHECK(i == -2147483648LL);
+        CHECK_THROWS_AS(read_from_string("2147483648", i), invalid_input);
+        CHECK_THROWS_AS(read_from_string("42 ", i), invalid_input);
+        CHECK_THROWS_AS(read_from_string("4x2", i), invalid_input);
+        CHECK_THROWS_AS(read_from_string("", i), invalid_input);
+        CHECK_THROWS_AS(read_from_string("-", i), invalid_input);
+        unsigned u;
+        read_from_string("-0", u);
+        CHECK(u == 0);
+        CHECK_THROWS_AS(read_from_string("-1", u), invalid_input);
+        uint64_t big;
+        read_from_string("00000000000018446744073709551615", big);
+        CHECK(big == 18446744073709551615ULL);
+        CHECK_THROWS_AS(read_from_string("18446744073709551616", big),
+                        invalid_input);
+        uint32_t seed = 777;
+        for (size_t i = 0; i < 1000; ++i) {
+            seed = seed * 1103515245 + 12345;
+            const int64_t value = (int64_t(seed) << 32 | (seed >> 3)) >>
+                                  (seed % 60);
+            int64_t result;
+            read_from_string(std::to_string(value), result);
+            CHECK(result == value);
+        }
+    }
+    {
+        double d;
+        read_from_string("1.5", d);
+        CHECK(d == 1.5);
+        read_from_string(" .5", d);
+        CHECK(d == 0.5);
+        read_from_string("+2e3", d);
+        CHECK(d == 2000);
+        read_from_string("-7.", d);
+        CHECK(d == -7);
+        CHECK_THROWS_AS(read_from_string("inf", d), invalid_input);
+        CHECK_THROWS_AS(read_from_string("1e999", d), invalid_input);
+        CHECK_THROWS_AS(read_from_string("1.5.", d), invalid_input);
+        CHECK_THROWS_AS(read_from_string("+-1", d), invalid_input);
+        CHECK_THROWS_AS(read_from_string("-+1", d), invalid_input);
+    }
+    {
+        char c;
+        bool b;
+        read_from_string(" x", c);
+        read_from_string("1", b);
+        CHECK(c == 'x');
+        CHECK(b);
+    }
+}
+
+TEST_CASE("Executor copies", "[length]")
+{
+    {
+        nfa_executor e1("a*b");
+        e1.next('a');
+        nfa_executor e2 = e1;
+        e2.next('b');
+        CHECK(e1.match() == match_state::UNSURE);
+        CHECK(e2.match() == match_state::ACCEPT);
+        CHECK(e2.longest_match() == 2);
+        e1.next('a');
+        e1.next('b');
+        CHECK(e1.longest_match() == 3);
+    }
+    {
+        std::vector<std::thread> threads;
+        std::vector<int> sums(4, 0);
+        for (size_t t = 0; t < sums.size(); ++t) {
+            threads.emplace_back([&sums, t]() {
+                for (int i = 0; i < 1000; ++i) {
+                    int x, y;
+                    sstr ss("1 ,  2");
+                    ss >> x >> sep(" *, *") >> y;
+                    sums[t] += x + y;
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        CHECK(sums == std::vector<int>(4, 3000));
+    }
+}
+
+template<typename Rx>
+void check_static_executor(Rx rx, const std::string& pattern)
+{
+    static_executor<typename std::decay<Rx>::type::source> s(rx);
+    nfa_executor d(pattern);
+    const std::string alphabet = pattern + "ab,; 1.";
+    uint32_t seed = 4321;
+    for (size_t i = 0; i < 2000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        const uint8_t sym = alphabet[(seed >> 16) % alphabet.size()];
+        s.next(sym);
+        d.next(sym);
+        if ((seed >> 8) % 4 != 0) {
+            s.start_path();
+            d.start_path();
+        }
+        REQUIRE(s.match() == d.match());
+        REQUIRE(s.longest_match() == d.longest_match());
+        if (s.match() == match_state::ACCEPT && (seed >> 4) % 3 == 0) {
+            REQUIRE(s.trim_short_matches() == d.trim_short_matches());
+        }
+        if ((seed >> 12) % 50 == 0) {
+            s.reset();
+            d.reset();
+        }
+    }
+}
+
+TEST_CASE("Static regex", "[regex]")
+{
+    check_static_executor(NSTR_RX(","), ",");
+    check_static_executor(NSTR_RX(", *"), ", *");
+    check_static_executor(NSTR_RX(" *; *"), " *; *");
+    check_static_executor(NSTR_RX(",{1,2}"), ",{1,2}");
+    check_static_executor(NSTR_RX("[ab]*a[ab]{3}"), "[ab]*a[ab]{3}");
+    check_static_executor(NSTR_RX("a+b?"), "a+b?");
+    check_static_executor(NSTR_RX("x?*"), "x?*");
+    check_static_executor(NSTR_RX("\\d+\\.\\d*"), "\\d+\\.\\d*");
+    check_static_executor(NSTR_RX("[^,]*;"), "[^,]*;");
+    check_static_executor(NSTR_RX("(ab|c)+d?"), "(ab|c)+d?");
+    check_static_executor(NSTR_RX("a(?:b|)c|d"), "a(?:b|)c|d");
+    check_static_executor(NSTR_RX("a?b*c|b"), "a?b*c|b");
+    check_static_executor(NSTR_RX("b|a?b*c"), "b|a?b*c");
+    {
+        int i, j;
+        sstr ss("10 ;  20");
+        ss >> i >> sep(NSTR_RX(" *; *")) >> j;
+        CHECK(i == 10);
+        CHECK(j == 20);
+    }
+    {
+        int i;
+        sstr ss("10,20");
+        CHECK_THROWS_AS(ss >> i >> sep(NSTR_RX(";")), invalid_input);
+    }
+    {
+        std::string str1, str2;
+        sstr ss("aaa,,,,,");
+        ss >> until(NSTR_RX(",{1,2}"), str1) >> str2;
+        CHECK(str1 == "aaa");
+        CHECK(str2 == ",,,");
+    }
+    {
+        std::string str1, str2;
+        sstr ss("abbbcX");
+        ss >> until(NSTR_RX("a?b*c|b"), str1) >> str2;
+        CHECK(str1 == "a");
+        CHECK(str2 == "X");
+    }
+    {
+        int x;
+        std::string str;
+        sstr ss("103");
+        ss >> pattn<int>(NSTR_RX("[10]*"), x) >> str;
+        CHECK(x == 10);
+        CHECK(str == "3");
+    }
+    {
+        std::vector<int> vec, refvec = { 10, 20, 30 };
+        sstr ss("10,,,,20,,30;;;");
+        std::string rest;
+        ss >> split(NSTR_RX(",+"), ";+", vec) >> rest;
+        CHECK(vec == refvec);
+        CHECK(rest == "");
+    }
+}
+
+TEST_CASE("Stream buffers", "[stream]")
+{
+    for (size_t chunk = 0; chunk < 8; ++chunk) {
+        chunked_buf buf("aaa,  bbb;10,20,,30\n1234xyz", chunk);
+        std::istream is(&buf);
+        std::string str1, str2;
+        std::vector<int> vec, refvec = { 10, 20, 30 };
+        int num;
+        is >> until(", *", str1) >> pattn("b+", str2) >> sep(";") >>
+            split(",+", "\n", vec) >> num >> sep("x");
+        CHECK(str1 == "aaa");
+        CHECK(str2 == "bbb");
+        CHECK(vec == refvec);
+        CHECK(num == 1234);
+        std::string rest;
+        is >> all(rest);
+        CHECK(rest == "yz");
+        CHECK(is.eof());
+    }
+    {
+        std::string str1, str2;
+        sstr ss("aaa;bbb");
+        ss.setstate(std::ios::failbit);
+        CHECK_THROWS_AS(ss >> until(";", str1), invalid_input);
+        ss.clear();
+        ss >> until(";", str1) >> str2;
+        CHECK(str1 == "aaa");
+        CHECK(str2 == "bbb");
+    }
+    {
+        // giving back more than the get area holds
+        std::string x, rest;
+        seek_only_buf seekable("xaaaaaaz rest", 2);
+        std::istream is(&seekable);
+        is >> pattn("xa{8}?", x) >> rest;
+        CHECK(x == "x");
+        CHECK(rest == "aaaaaaz");
+
+        one_way_buf buf("xaaaaaaz rest", 2);
+        std::istream one_way(&buf);
+        stream_source src(one_way);
+        src >> pattn("xa{8}?", x) >> rest;
+        CHECK(x == "x");
+        CHECK(rest == "aaaaaaz");
+    }
+    {
+        // streams that can't seek take back one byte from an earlier chunk,
+        // and go bad if more have to go back
+        std::string x, rest;
+        one_way_buf one_byte("xy rest", 1);
+        std::istream is1(&one_byte);
+        is1 >> pattn("xa?", x) >> rest;
+        CHECK(x == "x");
+        CHECK(rest == "y");
+        CHECK(!is1.bad());
+
+        one_way_buf more("xaaaaaaz rest", 2);
+        std::istream is2(&more);
+        is2 >> pattn("xa{8}?", x);
+        CHECK(x == "x");
+        CHECK(is2.bad());
+    }
+}
+
+TEST_CASE("nstr::mapped_file", "[mapped]")
+{
+    const std::string path = "nice_test_mapped.txt";
+    {
+        std::ofstream("nice_test_mapped.txt") << "aaa;10,20,30\nrest";
+        mapped_file file(path);
+        CHECK(file.view() == "aaa;10,20,30\nrest");
+        std::string str, rest;
+        std::vector<int> vec, refvec = { 10, 20, 30 };
+        file >> until(";", str) >> split(",", "\n", vec);
+        CHECK(str == "aaa");
+        CHECK(vec == refvec);
+        CHECK(file.tellg() == 13);
+        file >> all(rest);
+        CHECK(rest == "rest");
+        file.clear();
+        file.seekg(4);
+        int num;
+        file >> num;
+        CHECK(num == 10);
+    }
+    {
+        std::ofstream{ path };
+        mapped_file file(path);
+        std::string rest;
+        CHECK(file.view().empty());
+        file >> all(rest);
+        CHECK(rest.empty());
+        CHECK(file.eof());
+    }
+    std::remove(path.c_str());
+    CHECK_THROWS_AS(mapped_file(path), stream_error);
+}
+
+TEST_CASE("Sources", "[source]")
+{
+    const std::string input = "10 , 20;aaa,,bbb\n1,22,333;; 7 8 rest";
+    auto check = [](source& src) {
+        int a, b, c;
+        std::string str, rest;
+        std::vector<std::string> vec, refvec = { "aaa", "bbb" };
+        std::vector<int> nums, refnums = { 1, 22, 333 };
+        src >> a >> sep(" *, *") >> b >> sep(";") >>
+            split(",+", "\n", vec) >> until(";+", str) >> skip<int>() >> c >>
+            all(rest);
+        CHECK(a == 10);
+        CHECK(b == 20);
+        CHECK(vec == refvec);
+        CHECK(str == "1,22,333");
+        CHECK(c == 8);
+        CHECK(rest == " rest");
+        CHECK(src.eof());
+    };
+    {
+        string_source src(input);
+        check(src);
+        CHECK(src.rest().empty());
+    }
+    for (size_t buffer_size : { 1, 2, 3, 5, 100 }) {
+        std::FILE* file = std::tmpfile();
+        std::fputs(input.c_str(), file);
+        std::rewind(file);
+        {
+            file_source src(file, buffer_size);
+            check(src);
+        }
+        std::rewind(file);
+        {
+            fd_source src(fileno(file), buffer_size);
+            check(src);
+        }
+        std::fclose(file);
+        for (size_t chunk : { 0, 1, 4 }) {
+            one_way_buf buf(input, chunk);
+            std::istream is(&buf);
+            stream_source src(is, buffer_size);
+            check(src);
+            CHECK(is.eof());
+        }
+    }
+    {
+        int a;
+        double d;
+        char c;
+        string_source src(" 12abc -1.5e3x");
+        src >> a >> c;
+        CHECK(a == 12);
+        CHECK(c == 'a');
+        CHECK(src.rest() == "bc -1.5e3x");
+        src >> skip<std::string>() >> d;
+        CHECK(d == -1500);
+        CHECK_THROWS_AS(src >> a, invalid_input);
+        string_source empty("  ");
+        CHECK_THROWS_AS(empty >> a, invalid_input);
+    }
+}
+
+TEST_CASE("Push sources", "[source]")
+{
+    const std::string input = "GET /index.html;  42,7,1,22,333\nHTTP";
+    for (size_t chunk : { 1, 2, 5, 100 }) {
+        push_source in(4);
+        std::string method, path;
+        int num = 0;
+        std::vector<int> vec;
+        until<> method_end(" ", method);
+        until<> path_end(";", path);
+        sep<> space(" *");
+        auto number = pattn("[0-9]+", num);
+        sep<> comma(",");
+        auto numbers = split(",", NSTR_RX("\n"), vec);
+        std::vector<std::function<bool()>> steps = {
+            [&] { return resume(in, method_end); },
+            [&] { return resume(in, path_end); },
+            [&] { return resume(in, space); },
+            [&] { return resume(in, number); },
+            [&] { return resume(in, comma); },
+            [&] { return resume(in, numbers); },
+        };
+        size_t step = 0;
+        for (size_t pos = 0; pos < input.size(); pos += chunk) {
+            in.feed(input.substr(pos, chunk));
+            while (step < steps.size() && steps[step]()) {
+                ++step;
+            }
+        }
+        CHECK(step == steps.size());
+        CHECK(method == "GET");
+        CHECK(path == "/index.html");
+        CHECK(num == 42);
+        CHECK(vec == std::vector<int>({ 7, 1, 22, 333 }));
+        CHECK(!in.eof());
+        in.close();
+        std::string rest;
+        in >> rest;
+        CHECK(rest == "HTTP");
+        CHECK(in.eof());
+        CHECK_THROWS_AS(in.feed("x"), stream_error);
+    }
+    {
+        push_source in;
+        std::string line;
+        std::vector<std::string> lines;
+        until<> newline("\n+", line);
+        for (char c : std::string("a\nbb\n\nccc\n")) {
+            in.feed(&c, 1);
+            while (resume(in, newline)) {
+                lines.push_back(line);
+                line.clear();
+            }
+        }
+        CHECK(lines == std::vector<std::string>({ "a", "bb" }));
+        in.close();
+        CHECK(resume(in, newline));
+        CHECK(line == "ccc");
+        line.clear();
+        CHECK_THROWS_AS(resume(in, newline), invalid_input);
+    }
+    {
+        push_source in;
+        int i = 0;
+        auto number = pattn("[0-9]+", i);
+        in.feed("12");
+        CHECK(!resume(in, number));
+        in.feed("34x");
+        CHECK(resume(in, number));
+        CHECK(i == 1234);
+        CHECK_THROWS_AS(resume(in, number), invalid_input);
+        std::string rest;
+        in.close();
+        in >> rest;
+        CHECK(rest == "x");
+    }
+    {
+        // Bytes already read aren't kept once nothing can be given back.
+        push_source in(64);
+        int i = 0;
+        std::string line;
+        until<> newline("\n", line);
+        in.feed("+7 ");
+        in >> i;
+        CHECK(i == 7);
+        for (size_t chunk = 0; chunk < 1000; ++chunk) {
+            in.feed(std::string(100, 'a'));
+            CHECK(!resume(in, newline));
+        }
+        in.feed("\nx");
+        CHECK(resume(in, newline));
+        CHECK(line == " " + std::string(100000, 'a'));
+        CHECK(in.buffer_size() <= 256);
+    }
+}
+
+TEST_CASE("Split into views", "[split]")
+{
+    {
+        std::string input;
+        for (size_t i = 0; i < 100000; ++i) {
+            input += std::to_string(i) + (i + 1 < 100000 ? "," : "\n");
+        }
+        string_source src(input);
+        std::vector<std::string_view> views;
+        views.reserve(100000);
+        src >> split(",", "\n", views);
+        REQUIRE(views.size() == 100000);
+        CHECK(views[12345] == "12345");
+        CHECK(views.front().data() == input.data());
+        CHECK(views.back().data() + views.back().size() + 1 ==
+              input.data() + input.size());
+        CHECK(src.eof());
+    }
+    {
+        string_source src("3,, 1,2;rest");
+        std::set<int> nums, refnums = { 1, 2, 3 };
+        std::string rest;
+        src >> split(",+", ";", nums) >> all(rest);
+        CHECK(nums == refnums);
+        CHECK(rest == "rest");
+    }
+}
+
+TEST_CASE("nstr::split_range", "[split]")
+{
+    {
+        sstr ss("10,20,30\nrest");
+        std::vector<int> vec, refvec = { 10, 20, 30 };
+        for (int i : split_range<int>(ss, ",", "\n")) {
+            vec.push_back(i);
+        }
+        std::string rest;
+        ss >> rest;
+        CHECK(vec == refvec);
+        CHECK(rest == "rest");
+    }
+    {
+        sstr ss("1;2;3;4.");
+        int sum = 0;
+        for (int i : split_range<int>(ss, ";", NSTR_RX("\\."))) {
+            sum += i;
+            if (i == 2) {
+                break;
+            }
+        }
+        std::string rest;
+        ss >> rest;
+        CHECK(sum == 3);
+        CHECK(rest == "3;4.");
+    }
+    {
+        string_source src("a,bb,ccc\n");
+        auto range = split_range<std::string_view>(src, ",", "\n");
+        std::vector<std::string_view> vec(range.begin(), range.end());
+        std::vector<std::string_view> refvec = { "a", "bb", "ccc" };
+        CHECK(vec == refvec);
+        CHECK(range.begin() == range.end());
+        CHECK(src.eof());
+    }
+    {
+        sstr ss("1,x,3\n");
+        auto range = split_range<int>(ss, ",", "\n");
+        auto it = range.begin();
+        CHECK(*it == 1);
+        CHECK_THROWS_AS(++it, invalid_input);
+    }
+}
+
+TEST_CASE("nstr::records", "[records]")
+{
+    {
+        sstr ss("1,a,2.5,x y\n2,b,-1,z\n");
+        auto rows = records<int, skip_col, double, std::string>(",", "\n");
+        std::tuple<int, double, std::string> row;
+        ss >> rows(row);
+        CHECK(row == std::make_tuple(1, 2.5, std::string("x y")));
+        ss >> rows(row);
+        CHECK(row == std::make_tuple(2, -1.0, std::string("z")));
+        CHECK(ss.peek() == EOF);
+    }
+    {
+        struct point
+        {
+            long x, y;
+        };
+        string_source src("skip;3;4.;rest");
+        auto rows = records<skip_col, long, long>(";", NSTR_RX("\\."));
+        point p;
+        src >> rows(p);
+        CHECK(p.x == 3);
+        CHECK(p.y == 4);
+        CHECK(src.rest() == ";rest");
+    }
+    {
+        string_source src("key\tignored\tvalue\n");
+        auto rows = records<std::string_view, skip_col, std::string_view>(
+            "\t", "\n");
+        decltype(rows)::row_type row;
+        src >> rows(row);
+        CHECK(std::get<0>(row) == "key");
+        CHECK(std::get<1>(row) == "value");
+    }
+    {
+        auto rows = records<int, int>(",", "\n");
+        std::tuple<int, int> row;
+        sstr few("1\n");
+        CHECK_THROWS_AS(few >> rows(row), invalid_input);
+        sstr many("1,2,3\n");
+        CHECK_THROWS_AS(many >> rows(row), invalid_input);
+        sstr bad("1,x\n");
+        CHECK_THROWS_AS(bad >> rows(row), invalid_input);
+        sstr cut("1,2");
+        CHECK_THROWS_AS(cut >> rows(row), invalid_input);
+        sstr good("5,6\n");
+        good >> rows(row);
+        CHECK(row == std::make_tuple(5, 6));
+    }
+}
+
+TEST_CASE("nstr::parallel_split", "[split]")
+{
+    std::string data;
+    std::vector<int> refvec;
+    for (int i = 0; i < 200000; ++i) {
+        refvec.push_back(i);
+        data += std::to_string(i) + (i % 7 == 6 ? ";\n" : ",");
+    }
+    data.back() = ';';
+    data += "\n";
+    for (size_t threads : { 1, 3, 8 }) {
+        std::vector<int> vec;
+        parallel_split(data, ",", ";\n", vec, threads);
+        CHECK(vec == refvec);
+    }
+    {
+        // Terminator matches overlap, so chunk starts found from the middle
+        // of the data are often wrong and have to be split again.
+        std::string text;
+        uint32_t seed = 99;
+        for (size_t i = 0; i < 1000000; ++i) {
+            seed = seed * 1103515245 + 12345;
+            text.push_back("1a,a"[(seed >> 16) % 4]);
+        }
+        text += ",aa";
+        std::vector<std::string_view> vec, refvec;
+        string_source src(text);
+        while (!src.eof()) {
+            src >> split(",", "aa", refvec);
+        }
+        parallel_split(text, ",", "aa", vec, 4);
+        CHECK(vec == refvec);
+    }
+    {
+        std::vector<int> vec;
+        CHECK_THROWS_AS(parallel_split(data + "1,2", ",", ";\n", vec, 4),
+                        invalid_input);
+        std::set<int> st;
+        parallel_split(std::string_view("3,1;\n2;\n"), ",", ";\n", st);
+        CHECK(st == std::set<int>{ 1, 2, 3 });
+    }
+}
+
 TEST_CASE("nstr::until", "[until]")
 {
     {
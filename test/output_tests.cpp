@@ -1,6 +1,12 @@
 #include <catch.hpp>
+#include <cstdio>
+#include <iomanip>
+#include <limits>
 #include <set>
 #include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
 
 #include <nicestream.hpp>
 
@@ -32,3 +38,140 @@ TEST_CASE("nstr::join", "[join]")
         CHECK(ss.str() == "3, 4, 5");
     }
 }
+
+// What writing the items one by one to a stream with the same settings gives.
+template<typename ContT>
+std::string reference_join(const std::ostream& fmt,
+                           const std::string& sep,
+                           const ContT& items)
+{
+    std::stringstream ss;
+    ss.copyfmt(fmt);
+    bool first = true;
+    for (const auto& item : items) {
+        if (!first) {
+            ss << sep;
+        }
+        ss << item;
+        first = false;
+    }
+    return ss.str();
+}
+
+TEST_CASE("Buffered join", "[join]")
+{
+    const std::vector<long long> ints = {
+        0, -1, 42, std::numeric_limits<long long>::min(),
+        std::numeric_limits<long long>::max()
+    };
+    const std::vector<double> doubles = { 0.0, -0.5, 1.0 / 3, 1e300, 2.5e-7,
+                                          123456789.0, -1e-320 };
+    const std::vector<std::string> strings = { "", "ab", "c d" };
+    const std::vector<bool> bools = { true, false };
+    const std::vector<unsigned char> chars = { 'x', 'y' };
+    for (int setting = 0; setting < 4; ++setting) {
+        std::stringstream ss;
+        if (setting == 1) {
+            ss << std::setprecision(17);
+        } else if (setting == 2) {
+            ss << std::hex << std::showpos << std::fixed;
+        } else if (setting == 3) {
+            ss << std::setprecision(0);
+        }
+        ss.str("");
+        ss << join(", ", ints) << ';' << join(" ", doubles) << ';'
+           << join("|", strings) << ';' << join("", bools) << ';'
+           << join("-", chars);
+        CHECK(ss.str() == reference_join(ss, ", ", ints) + ';' +
+                              reference_join(ss, " ", doubles) + ';' +
+                              reference_join(ss, "|", strings) + ';' +
+                              reference_join(ss, "", bools) + ';' +
+                              reference_join(ss, "-", chars));
+    }
+    {
+        // more than fits in the buffer at once
+        std::vector<int> many(100000);
+        for (size_t i = 0; i < many.size(); ++i) {
+            many[i] = static_cast<int>(i * 7919) - 300000;
+        }
+        const std::string long_sep(100000, ',');
+        std::stringstream ss;
+        ss << join(", ", many) << join(long_sep, ints);
+        std::stringstream ref;
+        CHECK(ss.str() == reference_join(ref, ", ", many) +
+                              reference_join(ref, long_sep, ints));
+    }
+    {
+        std::stringstream ss;
+        ss.width(3);
+        ss << join(",", std::vector<int>{ 1, 2 });
+        CHECK(ss.str() == "  1,2");
+    }
+}
+
+TEST_CASE("Sinks", "[join]")
+{
+    const std::vector<int> vec = { 1, -2, 3 };
+    const std::string expected = "1, -2, 3;x 0.25 text";
+    auto write = [&](sink& out) {
+        out << join(", ", vec) << ';' << 'x' << ' ' << 0.25 << " text";
+    };
+    {
+        std::stringstream ss;
+        {
+            ostream_sink out(ss, 4);
+            write(out);
+        }
+        CHECK(ss.str() == expected);
+    }
+    for (size_t buffer_size : { 1, 5, 100 }) {
+        std::FILE* file = std::tmpfile();
+        {
+            file_sink out(file, buffer_size);
+            write(out);
+        }
+        {
+            fd_sink out(fileno(file), buffer_size);
+            write(out);
+            out.flush();
+        }
+        std::rewind(file);
+        char buf[100] = {};
+        CHECK(std::fread(buf, 1, sizeof(buf), file) == 2 * expected.size());
+        CHECK(std::string(buf) == expected + expected);
+        std::fclose(file);
+    }
+}
+
+TEST_CASE("nstr::parallel_join", "[join]")
+{
+    std::vector<double> doubles(100000);
+    for (size_t i = 0; i < doubles.size(); ++i) {
+        doubles[i] = (static_cast<double>(i) - 5000) / 7;
+    }
+    const std::vector<int> few = { 1, 2, 3 };
+    for (size_t threads : { 0, 1, 3, 16 }) {
+        std::stringstream ss, ref;
+        ss << std::setprecision(10) << parallel_join(", ", doubles, threads)
+           << ';' << parallel_join(",", few, threads) << ';'
+           << parallel_join(",", few.begin(), few.begin(), threads);
+        ref << std::setprecision(10) << join(", ", doubles) << ';'
+            << join(",", few) << ';';
+        CHECK(ss.str() == ref.str());
+    }
+    {
+        std::stringstream ss, ref;
+        ss << std::hex << parallel_join(" ", few, 2);
+        ref << std::hex << join(" ", few);
+        CHECK(ss.str() == ref.str());
+    }
+    {
+        std::stringstream ss, ref;
+        {
+            ostream_sink out(ss);
+            out << parallel_join(", ", doubles, 4);
+        }
+        ref << join(", ", doubles);
+        CHECK(ss.str() == ref.str());
+    }
+}